@@ -24,6 +24,19 @@
 #define CHOICE_ps 4
 #define CHOICE_pT 5
 
+// Flags for the property mask of the setState_xx_mask functions.
+// p, T, d, h, s and phase are always computed.
+#define PROPERTY_cp     1
+#define PROPERTY_cv     2
+#define PROPERTY_a      4
+#define PROPERTY_beta   8
+#define PROPERTY_kappa  16
+#define PROPERTY_ddhp   32
+#define PROPERTY_ddph   64
+#define PROPERTY_eta    128
+#define PROPERTY_lambda 256
+#define PROPERTY_ALL    511
+
 /*! Detect the platform in order to avoid the DLL commands from
  * making g++ choke. Code taken from CoolProp...
  */
@@ -91,6 +104,48 @@ typedef struct {
 
 } ExternalThermodynamicState;
 
+//! Structure-of-arrays output buffers for batched property calls
+/*!
+  Caller-owned arrays, one per property, each with as many elements as the
+  batch. Pointers set to NULL are skipped, and the corresponding properties
+  are not computed if the solver supports the property mask.
+*/
+
+typedef struct {
+
+	//! Temperatures
+    double *T;
+	//! Velocities of sound
+    double *a;
+	//! Isobaric expansion coefficients
+    double *beta;
+	//! Specific heat capacities cp
+    double *cp;
+	//! Specific heat capacities cv
+    double *cv;
+	//! Densities
+    double *d;
+	//! Derivatives of density wrt enthalpy at constant pressure
+    double *ddhp;
+	//! Derivatives of density wrt pressure at constant enthalpy
+    double *ddph;
+	//! Dynamic viscosities
+    double *eta;
+	//! Specific enthalpies
+    double *h;
+	//! Compressibilities
+    double *kappa;
+	//! Thermal conductivities
+    double *lambda;
+	//! Pressures
+    double *p;
+	//! Phase flags: 2 for two-phase, 1 for one-phase
+    int *phase;
+	//! Specific entropies
+    double *s;
+
+} ExternalThermodynamicStateArrays;
+
 //! ExternalSaturationProperties property struct
 /*!
   The ExternalSaturationProperties propery struct defines all the saturation properties
@@ -146,7 +201,80 @@ extern "C" {
 	EXPORT void TwoPhaseMedium_setState_ps_C_impl(double p, double s, int phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
 	EXPORT void TwoPhaseMedium_setState_hs_C_impl(double h, double s, int phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
 
+	EXPORT void *TwoPhaseMedium_createContext_C_impl(void);
+	EXPORT void TwoPhaseMedium_destroyContext_C_impl(void *context);
+	EXPORT void *TwoPhaseMedium_bindContext_C_impl(void *context);
+	EXPORT void TwoPhaseMedium_useContext_C_impl(void *context);
+	EXPORT void TwoPhaseMedium_useDefaultContext_C_impl(void);
+	EXPORT int TwoPhaseMedium_acquireSolver_C_impl(const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT int TwoPhaseMedium_releaseSolver_C_impl(const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_releaseAll_C_impl(void);
+	EXPORT long TwoPhaseMedium_getMemoryUsage_C_impl(const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT int TwoPhaseMedium_getMemoryReport_C_impl(char *report, int size);
+
+	EXPORT void TwoPhaseMedium_setParallelOptions_C_impl(int threads, int minChunk);
+	EXPORT void TwoPhaseMedium_setCacheDirectory_C_impl(const char *directory);
+	EXPORT void TwoPhaseMedium_setCriticalBand_C_impl(double width, double tolerance);
+	EXPORT int TwoPhaseMedium_prewarm_C_impl(const char *media);
+	EXPORT void TwoPhaseMedium_setStates_ph_C_impl(int n, const double *p, const double *h, const int *phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_pT_C_impl(int n, const double *p, const double *T, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_dT_C_impl(int n, const double *d, const double *T, const int *phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_ps_C_impl(int n, const double *p, const double *s, const int *phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_hs_C_impl(int n, const double *h, const double *s, const int *phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+
+	EXPORT void TwoPhaseMedium_setStates_ph_ordered_C_impl(int n, const double *p, const double *h, const int *phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_ph_ordered_fields_C_impl(int n, const double *p, const double *h, const int *phase, double *T, double *a, double *beta, double *cp, double *cv, double *d, double *ddhp, double *ddph, double *eta, double *kappa, double *lambda, int *phaseOut, double *s, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_ph_fields_C_impl(int n, const double *p, const double *h, const int *phase, int ordered, double *T, double *a, double *beta, double *cp, double *cv, double *d, double *ddhp, double *ddph, double *eta, double *kappa, double *lambda, int *phaseOut, double *s, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_ps_ordered_C_impl(int n, const double *p, const double *s, const int *phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_hs_ordered_C_impl(int n, const double *h, const double *s, const int *phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+
+	EXPORT void TwoPhaseMedium_setStates_ph_arrays_C_impl(int n, const double *p, const double *h, const int *phase, int ordered, const ExternalThermodynamicStateArrays *states, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_pT_arrays_C_impl(int n, const double *p, const double *T, const ExternalThermodynamicStateArrays *states, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_dT_arrays_C_impl(int n, const double *d, const double *T, const int *phase, const ExternalThermodynamicStateArrays *states, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_ps_arrays_C_impl(int n, const double *p, const double *s, const int *phase, int ordered, const ExternalThermodynamicStateArrays *states, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setStates_hs_arrays_C_impl(int n, const double *h, const double *s, const int *phase, int ordered, const ExternalThermodynamicStateArrays *states, const char *mediumName, const char *libraryName, const char *substanceName);
+
+	EXPORT void TwoPhaseMedium_setState_ph_der_C_impl(double p, double h, int phase, double p_der, double h_der, ExternalThermodynamicState *state_der, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_pT_der_C_impl(double p, double T, int phase, double p_der, double T_der, ExternalThermodynamicState *state_der, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_dT_der_C_impl(double d, double T, int phase, double d_der, double T_der, ExternalThermodynamicState *state_der, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_ps_der_C_impl(double p, double s, int phase, double p_der, double s_der, ExternalThermodynamicState *state_der, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_hs_der_C_impl(double h, double s, int phase, double h_der, double s_der, ExternalThermodynamicState *state_der, const char *mediumName, const char *libraryName, const char *substanceName);
+
+	EXPORT void TwoPhaseMedium_setState_ph_jac_C_impl(double p, double h, int phase, ExternalThermodynamicState *state, ExternalThermodynamicState *state_dp, ExternalThermodynamicState *state_dh, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_pT_jac_C_impl(double p, double T, ExternalThermodynamicState *state, ExternalThermodynamicState *state_dp, ExternalThermodynamicState *state_dT, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_dT_jac_C_impl(double d, double T, int phase, ExternalThermodynamicState *state, ExternalThermodynamicState *state_dd, ExternalThermodynamicState *state_dT, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_ps_jac_C_impl(double p, double s, int phase, ExternalThermodynamicState *state, ExternalThermodynamicState *state_dp, ExternalThermodynamicState *state_ds, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_hs_jac_C_impl(double h, double s, int phase, ExternalThermodynamicState *state, ExternalThermodynamicState *state_dh, ExternalThermodynamicState *state_ds, const char *mediumName, const char *libraryName, const char *substanceName);
+
+	EXPORT void TwoPhaseMedium_setState_ph_sat_C_impl(double p, double h, int phase, ExternalThermodynamicState *state, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_pT_sat_C_impl(double p, double T, ExternalThermodynamicState *state, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_dT_sat_C_impl(double d, double T, int phase, ExternalThermodynamicState *state, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_ps_sat_C_impl(double p, double s, int phase, ExternalThermodynamicState *state, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_hs_sat_C_impl(double h, double s, int phase, ExternalThermodynamicState *state, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
+
+	EXPORT void TwoPhaseMedium_setState_ph_sat_der_C_impl(double p, double h, int phase, double p_der, double h_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_pT_sat_der_C_impl(double p, double T, int phase, double p_der, double T_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_dT_sat_der_C_impl(double d, double T, int phase, double d_der, double T_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_ps_sat_der_C_impl(double p, double s, int phase, double p_der, double s_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_hs_sat_der_C_impl(double h, double s, int phase, double h_der, double s_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der, const char *mediumName, const char *libraryName, const char *substanceName);
+
+	EXPORT void TwoPhaseMedium_setState_ph_mask_C_impl(double p, double h, int phase, int mask, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_pT_mask_C_impl(double p, double T, int mask, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_dT_mask_C_impl(double d, double T, int phase, int mask, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_ps_mask_C_impl(double p, double s, int phase, int mask, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_hs_mask_C_impl(double h, double s, int phase, int mask, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+
+	EXPORT void TwoPhaseMedium_setState_ph_slot_C_impl(double p, double h, int phase, int slot, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_ps_slot_C_impl(double p, double s, int phase, int slot, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setState_hs_slot_C_impl(double h, double s, int phase, int slot, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_getFlashStatistics_C_impl(long *coldFlashes, long *warmFlashes, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_getTableStatistics_C_impl(long *tableEvaluations, long *exactEvaluations, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_getTileStatistics_C_impl(long *tiles, long *hits, long *misses, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT int TwoPhaseMedium_getTileReport_C_impl(char *report, int size, const char *mediumName, const char *libraryName, const char *substanceName);
+
 	EXPORT double TwoPhaseMedium_partialDeriv_state_C_impl(const char *of, const char *wrt, const char *cst, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT int TwoPhaseMedium_partialDeriv_id_C_impl(const char *of, const char *wrt, const char *cst);
+	EXPORT double TwoPhaseMedium_partialDeriv_state_id_C_impl(int id, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
 
 	EXPORT double TwoPhaseMedium_prandtlNumber_C_impl(ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
 	EXPORT double TwoPhaseMedium_temperature_C_impl(ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
@@ -164,10 +292,15 @@ extern "C" {
 	EXPORT double TwoPhaseMedium_pressure_C_impl(ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
 	EXPORT double TwoPhaseMedium_specificEntropy_C_impl(ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
 	EXPORT double TwoPhaseMedium_density_ph_der_C_impl(ExternalThermodynamicState *state,	const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT double TwoPhaseMedium_density_pT_der_C_impl(ExternalThermodynamicState *state, double p_der, double T_der, const char *mediumName, const char *libraryName, const char *substanceName);
 	EXPORT double TwoPhaseMedium_isentropicEnthalpy_C_impl(double p_downstream, ExternalThermodynamicState *refState,	const char *mediumName, const char *libraryName, const char *substanceName);
 
 	EXPORT void TwoPhaseMedium_setSat_p_C_impl(double p, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
 	EXPORT void TwoPhaseMedium_setSat_T_C_impl(double T, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setSats_p_C_impl(int n, const double *p, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setSats_T_C_impl(int n, const double *T, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setSat_p_state_C_impl(ExternalThermodynamicState *state, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
+	EXPORT void TwoPhaseMedium_setSat_T_state_C_impl(ExternalThermodynamicState *state, ExternalSaturationProperties *sat, const char *mediumName, const char *libraryName, const char *substanceName);
 	EXPORT void TwoPhaseMedium_setBubbleState_C_impl(ExternalSaturationProperties *sat, int phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
 	EXPORT void TwoPhaseMedium_setDewState_C_impl(ExternalSaturationProperties *sat, int phase, ExternalThermodynamicState *state, const char *mediumName, const char *libraryName, const char *substanceName);
 
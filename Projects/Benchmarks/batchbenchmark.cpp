@@ -0,0 +1,77 @@
+/* *****************************************************************
+ * Scaling benchmark for the batched property functions
+ *
+ * Evaluates TwoPhaseMedium_setStates_ph_C_impl for a batch of points
+ * with 1 to N threads and prints the run time and the speedup over
+ * the single-threaded run. Usage:
+ *
+ *   batchbenchmark [libraryName [substanceName [n [maxThreads]]]]
+ *
+ * The default is the TestMedium solver, which is very cheap and thus
+ * mostly measures the overhead of the thread pool; use e.g.
+ * "CoolProp Water" to measure a real backend. The CoolProp inputs span
+ * the liquid, two-phase and vapour regions of the fluid.
+ ********************************************************************/
+
+#include "externalmedialib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <sys/time.h>
+
+// The library reports errors through the Modelica utility functions
+extern "C" {
+void ModelicaError(const char *string){
+	printf("Error: %s\n", string);
+	exit(1);
+}
+
+void ModelicaMessage(const char *string){
+	printf("%s\n", string);
+}
+}
+
+static double now(){
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+int main(int argc, char *argv[]){
+	const char *libraryName = argc > 1 ? argv[1] : "TestMedium";
+	const char *substanceName = argc > 2 ? argv[2] : "";
+	int n = argc > 3 ? atoi(argv[3]) : 100000;
+	int maxThreads = argc > 4 ? atoi(argv[4]) : 8;
+	const char *mediumName = "Benchmark";
+	bool testMedium = strcmp(libraryName, "TestMedium") == 0;
+
+	// Inputs: pressure and enthalpy sweeps, interleaved so that
+	// expensive points are spread over the whole batch
+	std::vector<double> p(n), h(n);
+	for (int i = 0; i < n; i++){
+		double x = (double)(i % 997)/996;
+		double y = (double)(i % 101)/100;
+		p[i] = testMedium ? 1e5 + 1e5*x : 1e5 + 99e5*x;
+		h[i] = testMedium ? 1.2e5 + 1.5e5*y : 1e5 + 29e5*y;
+	}
+	std::vector<ExternalThermodynamicState> states(n);
+
+	// Create the solver and the shared data outside of the timed runs
+	TwoPhaseMedium_setParallelOptions_C_impl(maxThreads, 0);
+	TwoPhaseMedium_setStates_ph_C_impl(n, &p[0], &h[0], NULL, &states[0], mediumName, libraryName, substanceName);
+
+	printf("%s %s, %d points\n", libraryName, substanceName, n);
+	printf("threads   time [s]   speedup\n");
+	double reference = 0;
+	for (int threads = 1; threads <= maxThreads; threads++){
+		TwoPhaseMedium_setParallelOptions_C_impl(threads, 0);
+		double start = now();
+		TwoPhaseMedium_setStates_ph_C_impl(n, &p[0], &h[0], NULL, &states[0], mediumName, libraryName, substanceName);
+		double time = now() - start;
+		if (threads == 1)
+			reference = time;
+		printf("%7d %10.4f %9.2f\n", threads, time, reference/time);
+	}
+	return 0;
+}
@@ -0,0 +1,71 @@
+/* *****************************************************************
+ * Startup benchmark of the solvers
+ *
+ * Measures for each fluid the time until the first property call
+ * returns, starting from a process without any solver, followed by
+ * the time of the first calls that need the fluid constants and the
+ * near-critical saturation properties, which are computed on first
+ * need. Usage:
+ *
+ *   startupbenchmark [libraryName [substanceName ...]]
+ *
+ * The default is the TestMedium solver; use e.g.
+ * "CoolProp Water R134a CO2" to measure a real backend.
+ ********************************************************************/
+
+#include "externalmedialib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+// The library reports errors through the Modelica utility functions
+extern "C" {
+void ModelicaError(const char *string){
+	printf("Error: %s\n", string);
+	exit(1);
+}
+
+void ModelicaMessage(const char *string){
+	printf("%s\n", string);
+}
+}
+
+static double now(){
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+int main(int argc, char *argv[]){
+	const char *libraryName = argc > 1 ? argv[1] : "TestMedium";
+	const char *defaultSubstance = "";
+	const char **substanceNames = argc > 2 ? (const char **)argv + 2 : &defaultSubstance;
+	int substances = argc > 2 ? argc - 2 : 1;
+	const char *mediumName = "Benchmark";
+
+	printf("%s\n", libraryName);
+	printf("substance        first state [ms]   constants [ms]   near-critical [ms]\n");
+	for (int i = 0; i < substances; i++){
+		const char *substanceName = substanceNames[i];
+		ExternalThermodynamicState state;
+		ExternalSaturationProperties sat;
+
+		// Solver creation and first single-phase state
+		double start = now();
+		TwoPhaseMedium_setState_pT_C_impl(1e5, 300, &state, mediumName, libraryName, substanceName);
+		double first = now() - start;
+
+		// First call that needs the fluid constants
+		start = now();
+		double pc = TwoPhaseMedium_getCriticalPressure_C_impl(mediumName, libraryName, substanceName);
+		double constants = now() - start;
+
+		// First saturation call above the near-critical pressure
+		start = now();
+		TwoPhaseMedium_setSat_p_C_impl(pc, &sat, mediumName, libraryName, substanceName);
+		double nearCritical = now() - start;
+
+		printf("%-16s %16.3f %16.3f %20.3f\n", substanceName, 1e3*first, 1e3*constants, 1e3*nearCritical);
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+/* *****************************************************************
+ * Benchmark of the two-phase p-h states computed by the lever rule
+ *
+ * Evaluates TwoPhaseMedium_setState_ph_mask_C_impl for two-phase
+ * states at np pressures and nh enthalpies per pressure, requesting
+ * only the density derivatives, as the dynamic models of heat
+ * exchangers do. Three runs compute the same states:
+ *
+ *   flash       pressures interleaved: each state misses the saturation
+ *               cache of the solver and is computed by a flash, as
+ *               without the lever rule (np must exceed the 8 records
+ *               of the cache)
+ *   lever rule  states grouped by pressure: after the first flash at a
+ *               pressure, the others follow from the cached saturation
+ *               record
+ *   all props   grouped by pressure with all the properties requested,
+ *               which always needs a flash
+ *
+ * The largest difference between the states of the first two runs is
+ * printed as well. Usage:
+ *
+ *   twophasebenchmark [libraryName [substanceName [np [nh]]]]
+ *
+ * The default is "CoolProp Water".
+ ********************************************************************/
+
+#include "externalmedialib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <sys/time.h>
+
+// The library reports errors through the Modelica utility functions
+extern "C" {
+void ModelicaError(const char *string){
+	printf("Error: %s\n", string);
+	exit(1);
+}
+
+void ModelicaMessage(const char *string){
+	printf("%s\n", string);
+}
+}
+
+static double now(){
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+//! Largest relative difference of d, ddhp and ddph between two sets of states
+static double maxDifference(const std::vector<ExternalThermodynamicState> &a, const std::vector<ExternalThermodynamicState> &b){
+	double result = 0;
+	for (unsigned int i = 0; i < a.size(); i++){
+		double d = fabs(a[i].d - b[i].d)/fabs(b[i].d);
+		double ddhp = fabs(a[i].ddhp - b[i].ddhp)/fabs(b[i].ddhp);
+		double ddph = fabs(a[i].ddph - b[i].ddph)/fabs(b[i].ddph);
+		if (d > result) result = d;
+		if (ddhp > result) result = ddhp;
+		if (ddph > result) result = ddph;
+	}
+	return result;
+}
+
+int main(int argc, char *argv[]){
+	const char *libraryName = argc > 1 ? argv[1] : "CoolProp";
+	const char *substanceName = argc > 2 ? argv[2] : "Water";
+	int np = argc > 3 ? atoi(argv[3]) : 20;
+	int nh = argc > 4 ? atoi(argv[4]) : 50;
+	const char *mediumName = "Benchmark";
+	int mask = PROPERTY_ddhp | PROPERTY_ddph;
+
+	// Two-phase inputs between 5 % and 70 % of the critical pressure, at
+	// qualities between 0.02 and 0.98
+	double pc = TwoPhaseMedium_getCriticalPressure_C_impl(mediumName, libraryName, substanceName);
+	std::vector<double> p(np), hl(np), hv(np);
+	for (int i = 0; i < np; i++){
+		ExternalSaturationProperties sat;
+		p[i] = pc*(0.05 + 0.65*i/(np > 1 ? np - 1 : 1));
+		TwoPhaseMedium_setSat_p_C_impl(p[i], &sat, mediumName, libraryName, substanceName);
+		hl[i] = sat.hl;
+		hv[i] = sat.hv;
+	}
+	int n = np*nh;
+	std::vector<ExternalThermodynamicState> flash(n), lever(n), all(n);
+
+	double start = now();
+	for (int j = 0; j < nh; j++){
+		for (int i = 0; i < np; i++){
+			double x = 0.02 + 0.96*j/(nh > 1 ? nh - 1 : 1);
+			TwoPhaseMedium_setState_ph_mask_C_impl(p[i], hl[i] + x*(hv[i] - hl[i]), 0, mask, &flash[i*nh + j],
+												   mediumName, libraryName, substanceName);
+		}
+	}
+	double flashTime = now() - start;
+
+	start = now();
+	for (int i = 0; i < np; i++){
+		for (int j = 0; j < nh; j++){
+			double x = 0.02 + 0.96*j/(nh > 1 ? nh - 1 : 1);
+			TwoPhaseMedium_setState_ph_mask_C_impl(p[i], hl[i] + x*(hv[i] - hl[i]), 0, mask, &lever[i*nh + j],
+												   mediumName, libraryName, substanceName);
+		}
+	}
+	double leverTime = now() - start;
+
+	start = now();
+	for (int i = 0; i < np; i++){
+		for (int j = 0; j < nh; j++){
+			double x = 0.02 + 0.96*j/(nh > 1 ? nh - 1 : 1);
+			TwoPhaseMedium_setState_ph_mask_C_impl(p[i], hl[i] + x*(hv[i] - hl[i]), 0, PROPERTY_ALL, &all[i*nh + j],
+												   mediumName, libraryName, substanceName);
+		}
+	}
+	double allTime = now() - start;
+
+	printf("%s %s, %d pressures x %d enthalpies\n", libraryName, substanceName, np, nh);
+	printf("run          time per state [us]   speedup\n");
+	printf("flash        %19.3f %9.2f\n", 1e6*flashTime/n, 1.0);
+	printf("lever rule   %19.3f %9.2f\n", 1e6*leverTime/n, flashTime/leverTime);
+	printf("all props    %19.3f %9.2f\n", 1e6*allTime/n, flashTime/allTime);
+	printf("largest relative difference of d, ddhp, ddph: %g\n", maxDifference(lever, flash));
+	return 0;
+}
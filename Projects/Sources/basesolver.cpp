@@ -2,6 +2,11 @@
 #include <math.h>
 #include "externalmedialib.h"
 
+//! Property mask of the current call of the calling thread, see setPropertyMask
+static THREAD_LOCAL int currentPropertyMask = PROPERTY_ALL;
+//! Flash history slot of the current call of the calling thread, see setFlashSlot
+static THREAD_LOCAL int currentFlashSlot = 0;
+
 //! Constructor.
 /*!
   The constructor is copying the medium name, library name and substance name
@@ -12,6 +17,20 @@
 */
 BaseSolver::BaseSolver(const string &mediumName, const string &libraryName, const string &substanceName)
 	: mediumName(mediumName), libraryName(libraryName), substanceName(substanceName){
+	_warmStartTolerance = 1e-2;
+	_threadContextsUses = 0;
+	_statistics.coldFlashes = 0;
+	_statistics.warmFlashes = 0;
+	_statistics.tableEvaluations = 0;
+	_statistics.exactEvaluations = 0;
+	for (int i = 0; i < SATURATED_STATES_CACHE_SIZE; i++){
+		_saturatedStates[i].valid[0] = false;
+		_saturatedStates[i].valid[1] = false;
+	}
+	_saturatedStatesNext = 0;
+	for (int i = 0; i < SATURATION_CACHE_SIZE; i++)
+		_saturationRecords[i].valid = false;
+	_saturationRecordsNext = 0;
 }
 
 //! Destructor
@@ -23,50 +42,91 @@ BaseSolver::~BaseSolver(){
 
 //! Return molar mass (Default implementation provided)
 double BaseSolver::molarMass() const{
+	initFluidConstants();
 	return _fluidConstants.MM;
 }
 
 //! Return temperature at critical point (Default implementation provided)
 double BaseSolver::criticalTemperature() const{
+	initFluidConstants();
 	return _fluidConstants.Tc;
 }
 
 //! Return pressure at critical point (Default implementation provided)
 double BaseSolver::criticalPressure() const{
+	initFluidConstants();
 	return _fluidConstants.pc;
 }
 
 //! Return molar volume at critical point (Default implementation provided)
 double BaseSolver::criticalMolarVolume() const{
+	initFluidConstants();
 	return _fluidConstants.MM/_fluidConstants.dc;
 }
 
 //! Return density at critical point (Default implementation provided)
 double BaseSolver::criticalDensity() const{
+	initFluidConstants();
 	return _fluidConstants.dc;
 }
 
 //! Return specific enthalpy at critical point (Default implementation provided)
 double BaseSolver::criticalEnthalpy() const{
+	initFluidConstants();
 	return _fluidConstants.hc;
 }
 
 //! Return specific entropy at critical point (Default implementation provided)
 double BaseSolver::criticalEntropy() const{
+	initFluidConstants();
 	return _fluidConstants.sc;
 }
 
 //! Set fluid constants
 /*!
   This function sets the fluid constants which are defined in the
-  FluidConstants record in Modelica. It should be called when a new
-  solver is created.
+  FluidConstants record in Modelica. It is called by initFluidConstants()
+  when the constants are first needed, not when the solver is created.
 
   Must be re-implemented in the specific solver
 */
 void BaseSolver::setFluidConstants(){
 }
 
+//! Compute the fluid constants on first need
+/*!
+  Solvers are created for every medium a model refers to, but many of
+  them are rarely used; the constants, which may require iterations close
+  to the critical point, are therefore only computed on the first call
+  that needs them. Threads racing on the first use may all compute them,
+  see OnceFlag. Derived classes call this function before using
+  _fluidConstants.
+*/
+void BaseSolver::initFluidConstants() const{
+	if (_fluidConstantsOnce.done())
+		return;
+	const_cast<BaseSolver*>(this)->setFluidConstants();
+	_fluidConstantsOnce.setDone();
+}
+
+//! Compute all the data that is otherwise computed on first need
+/*!
+  Derived classes with further lazily computed data extend this function.
+*/
+void BaseSolver::prepare(){
+	initFluidConstants();
+}
+
+//! Return true if solver instances can be used concurrently
+/*!
+  Solvers returning true can be instantiated once per worker thread of
+  the thread pool, and batched calls are then evaluated in parallel.
+  The default is false, since many external libraries use global data.
+*/
+bool BaseSolver::isReentrant(){
+	return false;
+}
+
 //! Set state from p, h, and phase
 /*!
   This function sets the thermodynamic state record for the given pressure
@@ -151,6 +211,519 @@ void BaseSolver::setState_hs(double &h, double &s, int &phase, ExternalThermodyn
 	errorMessage((char*)"Internal error: setState_hs() not implemented in the Solver object");
 }
 
+//! Compute properties for an array of inputs
+/*!
+  This function computes the properties for n pairs of inputs of the same
+  kind. The default implementation calls the setState_xx function of the
+  solver for each element; solver objects can override it to share the
+  setup work among all the elements or to use vectorized routines.
+
+  If the elements are ordered, i.e. each element is a neighbour of the
+  previous one in space (consecutive cells of a 1-D discretization),
+  solvers with iterative flashes may start each flash from the solution
+  of the previous element.
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param n Number of elements
+  @param input1 Array of first inputs
+  @param input2 Array of second inputs
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL if unknown for all elements
+  @param ordered True if consecutive elements are neighbours
+  @param properties Array of ExternalThermodynamicState property structs
+*/
+void BaseSolver::setStates(int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+						   bool ordered, ExternalThermodynamicState *const properties){
+	if (inputChoice < CHOICE_dT || inputChoice > CHOICE_pT){
+		errorMessage((char*)"Internal error: invalid input choice in setStates()");
+		return;
+	}
+	for (int i = 0; i < n; i++){
+		double in1 = input1[i];
+		double in2 = input2[i];
+		int ph = phase ? phase[i] : 0;
+		switch(inputChoice){
+		case CHOICE_ph: setState_ph(in1, in2, ph, properties + i); break;
+		case CHOICE_pT: setState_pT(in1, in2, properties + i); break;
+		case CHOICE_dT: setState_dT(in1, in2, ph, properties + i); break;
+		case CHOICE_ps: setState_ps(in1, in2, ph, properties + i); break;
+		case CHOICE_hs: setState_hs(in1, in2, ph, properties + i); break;
+		}
+	}
+}
+
+//! Compute properties for an array of inputs into separate arrays per property
+/*!
+  This function computes the properties for n pairs of inputs of the same
+  kind and writes them to the non-NULL arrays of the output descriptor.
+  Only the properties with an output array are computed, by setting the
+  property mask of the current call (see setPropertyMask), which is reset
+  at the start of the next call of the thread.
+
+  The default implementation calls setStates on blocks of 64 elements and
+  copies the block to the arrays. The solvers compute one state record at
+  a time from their state object, and the cost of a state is dominated by
+  the equation of state, so the block stays in the first-level cache and
+  the copy is negligible; the arrays give the layout to the caller rather
+  than to the computation. Solver objects can override this function to
+  write the arrays directly.
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param n Number of elements
+  @param input1 Array of first inputs
+  @param input2 Array of second inputs
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param ordered True if consecutive elements are neighbours
+  @param properties Output arrays
+*/
+void BaseSolver::setStates_arrays(int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+								  bool ordered, const ExternalThermodynamicStateArrays &properties){
+	setPropertyMask(arraysPropertyMask(properties));
+
+	const int blockSize = 64;
+	ExternalThermodynamicState block[blockSize];
+	for (int begin = 0; begin < n; begin += blockSize){
+		int m = n - begin < blockSize ? n - begin : blockSize;
+		// The warm start history carries over from one block to the next
+		setStates(inputChoice, m, input1 + begin, input2 + begin, phase ? phase + begin : NULL, ordered, block);
+		for (int i = 0; i < m; i++){
+			const ExternalThermodynamicState &state = block[i];
+			int j = begin + i;
+			if (properties.T)      properties.T[j]      = state.T;
+			if (properties.a)      properties.a[j]      = state.a;
+			if (properties.beta)   properties.beta[j]   = state.beta;
+			if (properties.cp)     properties.cp[j]     = state.cp;
+			if (properties.cv)     properties.cv[j]     = state.cv;
+			if (properties.d)      properties.d[j]      = state.d;
+			if (properties.ddhp)   properties.ddhp[j]   = state.ddhp;
+			if (properties.ddph)   properties.ddph[j]   = state.ddph;
+			if (properties.eta)    properties.eta[j]    = state.eta;
+			if (properties.h)      properties.h[j]      = state.h;
+			if (properties.kappa)  properties.kappa[j]  = state.kappa;
+			if (properties.lambda) properties.lambda[j] = state.lambda;
+			if (properties.p)      properties.p[j]      = state.p;
+			if (properties.phase)  properties.phase[j]  = state.phase;
+			if (properties.s)      properties.s[j]      = state.s;
+		}
+	}
+}
+
+//! Return the property mask selecting the properties with an output array
+/*!
+  @param properties Output arrays
+*/
+int BaseSolver::arraysPropertyMask(const ExternalThermodynamicStateArrays &properties){
+	int mask = 0;
+	if (properties.cp)     mask |= PROPERTY_cp;
+	if (properties.cv)     mask |= PROPERTY_cv;
+	if (properties.a)      mask |= PROPERTY_a;
+	if (properties.beta)   mask |= PROPERTY_beta;
+	if (properties.kappa)  mask |= PROPERTY_kappa;
+	if (properties.ddhp)   mask |= PROPERTY_ddhp;
+	if (properties.ddph)   mask |= PROPERTY_ddph;
+	if (properties.eta)    mask |= PROPERTY_eta;
+	if (properties.lambda) mask |= PROPERTY_lambda;
+	return mask;
+}
+
+//! Compute properties and saturation properties from p, h, and phase
+/*!
+  This function computes the properties for the specified inputs, together
+  with the saturation properties at the pressure of the resulting state.
+  The default implementations of the setState_xx_sat functions call
+  setState_xx and then setSat_p_newState, which can be overridden to reuse
+  the results of the state computation.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param properties ExternalThermodynamicState property struct
+  @param satProperties ExternalSaturationProperties property struct
+*/
+void BaseSolver::setState_ph_sat(double &p, double &h, int &phase, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties){
+	setState_ph(p, h, phase, properties);
+	setSat_p_newState(properties, satProperties);
+	storeSaturationProperties(true, properties->p, *satProperties);
+}
+
+//! Compute properties and saturation properties from p and T
+void BaseSolver::setState_pT_sat(double &p, double &T, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties){
+	setState_pT(p, T, properties);
+	setSat_p_newState(properties, satProperties);
+	storeSaturationProperties(true, properties->p, *satProperties);
+}
+
+//! Compute properties and saturation properties from d, T, and phase
+void BaseSolver::setState_dT_sat(double &d, double &T, int &phase, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties){
+	setState_dT(d, T, phase, properties);
+	setSat_p_newState(properties, satProperties);
+	storeSaturationProperties(true, properties->p, *satProperties);
+}
+
+//! Compute properties and saturation properties from p, s, and phase
+void BaseSolver::setState_ps_sat(double &p, double &s, int &phase, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties){
+	setState_ps(p, s, phase, properties);
+	setSat_p_newState(properties, satProperties);
+	storeSaturationProperties(true, properties->p, *satProperties);
+}
+
+//! Compute properties and saturation properties from h, s, and phase
+void BaseSolver::setState_hs_sat(double &h, double &s, int &phase, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties){
+	setState_hs(h, s, phase, properties);
+	setSat_p_newState(properties, satProperties);
+	storeSaturationProperties(true, properties->p, *satProperties);
+}
+
+//! Compute saturation properties for a newly computed state
+/*!
+  This function sets the saturation properties at the pressure of the
+  state that this solver has just computed. The default implementation
+  calls setSat_p; solvers that keep the last state internally can override
+  it to avoid a new saturation computation.
+  @param properties ExternalThermodynamicState property struct of the new state
+  @param satProperties ExternalSaturationProperties property struct
+*/
+void BaseSolver::setSat_p_newState(ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties){
+	setSat_p(properties->p, satProperties);
+}
+
+//! Look up a saturation properties record in the cache
+/*!
+  @param byPressure True if the record was computed for a pressure, false for a temperature
+  @param input Pressure or temperature the record was computed for
+  @param satProperties ExternalSaturationProperties property struct where to copy the record
+*/
+bool BaseSolver::findSaturationProperties(bool byPressure, double input, ExternalSaturationProperties *const satProperties){
+	ScopedLock lock(_saturationRecordsMutex);
+	for (int i = 0; i < SATURATION_CACHE_SIZE; i++){
+		const SaturationRecord &record = _saturationRecords[i];
+		if (record.valid && record.byPressure == byPressure && record.input == input){
+			*satProperties = record.properties;
+			return true;
+		}
+	}
+	return false;
+}
+
+//! Store a saturation properties record in the cache
+/*!
+  @param byPressure True if the record was computed for a pressure, false for a temperature
+  @param input Pressure or temperature the record was computed for
+  @param satProperties Saturation properties record
+*/
+void BaseSolver::storeSaturationProperties(bool byPressure, double input, const ExternalSaturationProperties &satProperties){
+	ScopedLock lock(_saturationRecordsMutex);
+	int i;
+	for (i = 0; i < SATURATION_CACHE_SIZE; i++){
+		const SaturationRecord &record = _saturationRecords[i];
+		if (record.valid && record.byPressure == byPressure && record.input == input)
+			break;
+	}
+	if (i == SATURATION_CACHE_SIZE){
+		// Not in the cache yet, replace the oldest record
+		i = _saturationRecordsNext;
+		_saturationRecordsNext = (_saturationRecordsNext + 1) % SATURATION_CACHE_SIZE;
+	}
+	SaturationRecord &record = _saturationRecords[i];
+	record.valid = true;
+	record.byPressure = byPressure;
+	record.input = input;
+	record.properties = satProperties;
+}
+
+//! Compute the time derivative of the state record
+/*!
+  This function returns the time derivative of the state record computed
+  from the given inputs, for given time derivatives of the inputs. It is
+  used by the derivative annotations of the setState functions.
+
+  The state itself is taken from the last setState call of the calling
+  thread if it had the same inputs (see storeLastState), otherwise it is
+  recomputed. The derivatives of p, h, T, d and s are computed analytically:
+  the input derivatives are first converted to derivatives of p and h, which
+  are then propagated with ddph, ddhp and the Bridgman relations also used by
+  computeDerivatives, or with the slope of the saturation curve in the
+  two-phase region. The derivatives of the other properties would require
+  second derivatives of the equation of state and are set to NAN.
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param input1 First input
+  @param input2 Second input
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param input1_der Time derivative of the first input
+  @param input2_der Time derivative of the second input
+  @param derivatives ExternalThermodynamicState property struct where to write the time derivatives
+*/
+void BaseSolver::setState_der(int inputChoice, double &input1, double &input2, int &phase, double input1_der, double input2_der,
+							  ExternalThermodynamicState *const derivatives){
+	ExternalThermodynamicState state;
+	recallState(inputChoice, input1, input2, phase, &state);
+
+	// Slope of the saturation curve, only needed in the two-phase region
+	bool twoPhase = (state.phase == 2);
+	double dTp = 0;
+	if (twoPhase){
+		ExternalSaturationProperties sat;
+		setSat_p_state(&state, &sat);
+		dTp = sat.dTp;
+	}
+
+	// Convert the input derivatives to derivatives of p and h
+	double p_der, h_der;
+	switch(inputChoice){
+	case CHOICE_ph:
+		p_der = input1_der;
+		h_der = input2_der;
+		break;
+	case CHOICE_ps:
+		// T ds = dh - dp/d
+		p_der = input1_der;
+		h_der = state.T*input2_der + p_der/state.d;
+		break;
+	case CHOICE_hs:
+		h_der = input1_der;
+		p_der = state.d*(h_der - state.T*input2_der);
+		break;
+	case CHOICE_pT:
+		// Always one-phase conditions with pT inputs
+		p_der = input1_der;
+		h_der = (1 - state.T*state.beta)/state.d*p_der + state.cp*input2_der;
+		break;
+	default: // CHOICE_dT
+		if (twoPhase){
+			p_der = input2_der/dTp;
+			h_der = (input1_der - state.ddph*p_der)/state.ddhp;
+		}
+		else{
+			p_der = state.beta/state.kappa*input2_der + input1_der/(state.d*state.kappa);
+			h_der = (1 - state.T*state.beta)/state.d*p_der + state.cp*input2_der;
+		}
+		break;
+	}
+
+	derivatives->p = p_der;
+	derivatives->h = h_der;
+	derivatives->d = state.ddph*p_der + state.ddhp*h_der;
+	if (twoPhase)
+		derivatives->T = dTp*p_der;
+	else
+		derivatives->T = (state.T*state.beta - 1)/(state.d*state.cp)*p_der + h_der/state.cp;
+	derivatives->s = (h_der - p_der/state.d)/state.T;
+	derivatives->phase = 0;
+	derivatives->a = NAN;
+	derivatives->beta = NAN;
+	derivatives->cp = NAN;
+	derivatives->cv = NAN;
+	derivatives->ddhp = NAN;
+	derivatives->ddph = NAN;
+	derivatives->eta = NAN;
+	derivatives->kappa = NAN;
+	derivatives->lambda = NAN;
+}
+
+//! Compute the time derivatives of the state record and of the saturation properties
+/*!
+  This function is used by the derivative annotations of the setState_xx_sat
+  functions. The state derivatives are those of setState_der. The saturation
+  properties only depend on the pressure of the state, so their derivatives
+  are the slopes stored in the record times the pressure derivative, and
+  the entropies follow from T ds = dh - dp/d along the saturation line.
+  Above the critical pressure the record is the constant near-critical one
+  and its derivatives are zero. The derivatives of the slopes and of the
+  surface tension would require second derivatives and are set to NAN.
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param input1 First input
+  @param input2 Second input
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param input1_der Time derivative of the first input
+  @param input2_der Time derivative of the second input
+  @param derivatives ExternalThermodynamicState property struct where to write the time derivatives
+  @param satDerivatives ExternalSaturationProperties property struct where to write the time derivatives
+*/
+void BaseSolver::setState_sat_der(int inputChoice, double &input1, double &input2, int &phase, double input1_der, double input2_der,
+								  ExternalThermodynamicState *const derivatives, ExternalSaturationProperties *const satDerivatives){
+	ExternalThermodynamicState state;
+	ExternalSaturationProperties sat;
+	recallState(inputChoice, input1, input2, phase, &state);
+	setState_der(inputChoice, input1, input2, phase, input1_der, input2_der, derivatives);
+	setSat_p_state(&state, &sat);
+
+	double p_der = sat.psat == state.p ? derivatives->p : 0;
+	satDerivatives->psat = p_der;
+	satDerivatives->Tsat = sat.dTp*p_der;
+	satDerivatives->dl = sat.ddldp*p_der;
+	satDerivatives->dv = sat.ddvdp*p_der;
+	satDerivatives->hl = sat.dhldp*p_der;
+	satDerivatives->hv = sat.dhvdp*p_der;
+	satDerivatives->sl = (sat.dhldp - 1/sat.dl)/sat.Tsat*p_der;
+	satDerivatives->sv = (sat.dhvdp - 1/sat.dv)/sat.Tsat*p_der;
+	satDerivatives->dTp = NAN;
+	satDerivatives->ddldp = NAN;
+	satDerivatives->ddvdp = NAN;
+	satDerivatives->dhldp = NAN;
+	satDerivatives->dhvdp = NAN;
+	satDerivatives->sigma = NAN;
+}
+
+//! Compute properties together with their sensitivities to the inputs
+/*!
+  This function computes the state for the specified inputs, together with
+  the partial derivatives of all the properties with respect to the first
+  input at constant second input (derivatives1) and with respect to the
+  second input at constant first input (derivatives2).
+
+  The derivatives of p, h, T, d and s are computed analytically by
+  setState_der from the state of the flash. The derivatives of the other
+  properties with respect to T and d are taken from the solver (see
+  propertyDerivatives_dT) and chained with the analytic derivatives of T
+  and d. The properties the solver cannot differentiate, e.g. the
+  transport properties, are differentiated by forward differences, which
+  cost two more setState_dT calls; their derivatives are NAN if either
+  difference leaves the phase of the state, so that no derivative is taken
+  across the phase boundary. Properties that are not computed (NAN) have
+  NAN derivatives.
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param input1 First input
+  @param input2 Second input
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param properties ExternalThermodynamicState property struct where to write the state
+  @param derivatives1 ExternalThermodynamicState property struct where to write the derivatives wrt the first input
+  @param derivatives2 ExternalThermodynamicState property struct where to write the derivatives wrt the second input
+*/
+void BaseSolver::setState_jac(int inputChoice, double &input1, double &input2, int &phase, ExternalThermodynamicState *const properties,
+							  ExternalThermodynamicState *const derivatives1, ExternalThermodynamicState *const derivatives2){
+	switch(inputChoice){
+	case CHOICE_ph: setState_ph(input1, input2, phase, properties); break;
+	case CHOICE_pT: setState_pT(input1, input2, properties); break;
+	case CHOICE_dT: setState_dT(input1, input2, phase, properties); break;
+	case CHOICE_ps: setState_ps(input1, input2, phase, properties); break;
+	case CHOICE_hs: setState_hs(input1, input2, phase, properties); break;
+	default:
+		errorMessage((char*)"Internal error: invalid input choice in setState_jac()");
+		return;
+	}
+	storeLastState(inputChoice, input1, input2, phase, *properties);
+
+	// Analytic derivatives of p, h, T, d and s
+	setState_der(inputChoice, input1, input2, phase, 1.0, 0.0, derivatives1);
+	setState_der(inputChoice, input1, input2, phase, 0.0, 1.0, derivatives2);
+
+	// Derivatives of the remaining properties wrt T and d, from the solver if possible
+	double ExternalThermodynamicState::*const fields[] = {
+		&ExternalThermodynamicState::a, &ExternalThermodynamicState::beta,
+		&ExternalThermodynamicState::cp, &ExternalThermodynamicState::cv,
+		&ExternalThermodynamicState::ddhp, &ExternalThermodynamicState::ddph,
+		&ExternalThermodynamicState::eta, &ExternalThermodynamicState::kappa,
+		&ExternalThermodynamicState::lambda};
+	const unsigned int nFields = sizeof(fields)/sizeof(fields[0]);
+	ExternalThermodynamicState partialsT, partialsD;
+	bool differences = false;
+	for (unsigned int i = 0; i < nFields; i++)
+		partialsT.*fields[i] = partialsD.*fields[i] = NAN;
+	propertyDerivatives_dT(properties, &partialsT, &partialsD);
+	for (unsigned int i = 0; i < nFields; i++)
+		if (!ISNAN(properties->*fields[i]) && (ISNAN(partialsT.*fields[i]) || ISNAN(partialsD.*fields[i])))
+			differences = true;
+
+	// Forward differences for the others, within the phase of the state
+	ExternalThermodynamicState stateT, stateD;
+	double dT = 0, dd = 0;
+	bool samePhase = false;
+	if (differences){
+		const double eps = 1e-6;
+		double T = properties->T*(1 + eps);
+		double d = properties->d*(1 + eps);
+		dT = T - properties->T;
+		dd = d - properties->d;
+		int phaseT = 0, phaseD = 0;
+		setState_dT(properties->d, T, phaseT, &stateT);
+		setState_dT(d, properties->T, phaseD, &stateD);
+		samePhase = (stateT.phase == properties->phase && stateD.phase == properties->phase);
+	}
+
+	for (unsigned int i = 0; i < nFields; i++){
+		double ExternalThermodynamicState::*const field = fields[i];
+		double fT = partialsT.*field, fd = partialsD.*field;
+		if (ISNAN(properties->*field) || ((ISNAN(fT) || ISNAN(fd)) && !samePhase)){
+			derivatives1->*field = NAN;
+			derivatives2->*field = NAN;
+			continue;
+		}
+		if (ISNAN(fT) || ISNAN(fd)){
+			fT = (stateT.*field - properties->*field)/dT;
+			fd = (stateD.*field - properties->*field)/dd;
+		}
+		derivatives1->*field = fT*derivatives1->T + fd*derivatives1->d;
+		derivatives2->*field = fT*derivatives2->T + fd*derivatives2->d;
+	}
+}
+
+//! Compute the derivatives of the properties of a state wrt T and d
+/*!
+  This function writes the derivatives of a, beta, cp, cv, ddhp, ddph,
+  eta, kappa and lambda with respect to T at constant d to derivativesT,
+  and with respect to d at constant T to derivativesD, see setState_jac.
+  The derivatives it cannot compute are left unchanged (NAN).
+
+  Can be re-implemented in the specific solver; the base function
+  computes none of them.
+  @param properties ExternalThermodynamicState property struct of the state
+  @param derivativesT ExternalThermodynamicState property struct where to write the derivatives wrt T
+  @param derivativesD ExternalThermodynamicState property struct where to write the derivatives wrt d
+*/
+void BaseSolver::propertyDerivatives_dT(ExternalThermodynamicState *const properties, ExternalThermodynamicState *const derivativesT,
+										ExternalThermodynamicState *const derivativesD){
+}
+
+//! Recall the result of a setState call
+/*!
+  This function returns the state stored by storeLastState if the calling
+  thread's last setState call had the same inputs, and computes it
+  otherwise.
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param input1 First input
+  @param input2 Second input
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param properties ExternalThermodynamicState property struct
+*/
+void BaseSolver::recallState(int inputChoice, double &input1, double &input2, int &phase, ExternalThermodynamicState *const properties){
+	{
+		ScopedLock lock(_threadContextsMutex);
+		const ThreadContext &context = threadContext();
+		// The pT flash does not use the phase, so a pT state matches any phase
+		if (context.lastInputChoice == inputChoice && context.lastInput1 == input1 &&
+			context.lastInput2 == input2 && (context.lastPhase == phase || inputChoice == CHOICE_pT)){
+			*properties = context.lastState;
+			return;
+		}
+	}
+	switch(inputChoice){
+	case CHOICE_ph: setState_ph(input1, input2, phase, properties); break;
+	case CHOICE_pT: setState_pT(input1, input2, properties); break;
+	case CHOICE_dT: setState_dT(input1, input2, phase, properties); break;
+	case CHOICE_ps: setState_ps(input1, input2, phase, properties); break;
+	case CHOICE_hs: setState_hs(input1, input2, phase, properties); break;
+	default:
+		errorMessage((char*)"Internal error: invalid input choice in setState_der()");
+	}
+}
+
+//! Remember the result of a setState call
+/*!
+  This function stores the inputs and the result of the last setState call
+  of the calling thread, so that a following setState_der call with the
+  same inputs does not have to compute the state again.
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param input1 First input
+  @param input2 Second input
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param properties ExternalThermodynamicState property struct computed for the inputs
+*/
+void BaseSolver::storeLastState(int inputChoice, double input1, double input2, int phase, const ExternalThermodynamicState &properties){
+	ScopedLock lock(_threadContextsMutex);
+	ThreadContext &context = threadContext();
+	context.lastInputChoice = inputChoice;
+	context.lastInput1 = input1;
+	context.lastInput2 = input2;
+	context.lastPhase = phase;
+	context.lastState = properties;
+}
+
 //! Compute partial derivative from a populated state record
 /*!
   This function computes the derivative of the specified input. Note that it requires
@@ -166,10 +739,115 @@ void BaseSolver::setState_hs(double &h, double &s, int &phase, ExternalThermodyn
 */
 double BaseSolver::partialDeriv_state(const string &of, const string &wrt, const string &cst, ExternalThermodynamicState *const properties){
 //double BaseSolver::partialDeriv_state(const char *of, const char *wrt, const char *cst, ExternalThermodynamicState *const properties){
+	double res;
+	if (partialDeriv_fromState(partialDeriv_id(of, wrt, cst), properties, res))
+		return res;
 	errorMessage((char*)"Internal error: partialDeriv_state() not implemented in the Solver object");
 	return 0.;
 }
 
+//! Properties supported by the derivative engine, in the order of the derivative ids
+static const char *const derivProperties[] = {"p", "T", "d", "h", "s", "u"};
+static const int nDerivProperties = 6;
+
+//! Return the index of a property in derivProperties, -1 if not supported
+static int derivPropertyIndex(const string &name){
+	for (int i = 0; i < nDerivProperties; i++)
+		if (!name.compare(derivProperties[i]))
+			return i;
+	return -1;
+}
+
+//! Compile a partial derivative id
+/*!
+  This function converts the strings defining a partial derivative into an
+  integer id, to be computed once per call site and passed to
+  partialDeriv_state_id. Supported properties are p, T, d, h, s and u.
+  @param of Property to differentiate
+  @param wrt Property to differentiate in
+  @param cst Property to remain constant
+*/
+int BaseSolver::partialDeriv_id(const string &of, const string &wrt, const string &cst){
+	int iOf = derivPropertyIndex(of);
+	int iWrt = derivPropertyIndex(wrt);
+	int iCst = derivPropertyIndex(cst);
+	if (iOf < 0 || iWrt < 0 || iCst < 0 || iWrt == iCst){
+		errorMessage((char*)"Internal error: invalid partial derivative, properties must be p, T, d, h, s or u");
+		return -1;
+	}
+	return (iOf*nDerivProperties + iWrt)*nDerivProperties + iCst;
+}
+
+//! Compute partial derivative from a populated state record and a derivative id
+/*!
+  This function computes the partial derivative with the id returned by
+  partialDeriv_id. One-phase states are handled by the derivative engine
+  without any new property computation, other states are passed on to
+  partialDeriv_state.
+  @param id Derivative id, see partialDeriv_id
+  @param properties ExternalThermodynamicState property struct
+*/
+double BaseSolver::partialDeriv_state_id(int id, ExternalThermodynamicState *const properties){
+	double res;
+	if (partialDeriv_fromState(id, properties, res))
+		return res;
+	if (id < 0 || id >= nDerivProperties*nDerivProperties*nDerivProperties){
+		errorMessage((char*)"Internal error: invalid partial derivative id");
+		return 0.;
+	}
+	int iCst = id % nDerivProperties;
+	int iWrt = (id / nDerivProperties) % nDerivProperties;
+	int iOf = id / (nDerivProperties*nDerivProperties);
+	return partialDeriv_state(derivProperties[iOf], derivProperties[iWrt], derivProperties[iCst], properties);
+}
+
+//! Derivative engine
+/*!
+  This function computes any partial derivative (da/db)_c with a, b and c
+  among p, T, d, h, s and u from the state record alone. The derivatives of
+  all properties with respect to the independent variables T and d are
+  obtained from cp, cv, beta and kappa:
+
+    dp/dT = beta/kappa, dp/dd = 1/(d kappa), ds/dT = cv/T, ds/dd = -beta/(kappa d^2),
+    du/dT = cv, du/dd = (p - T dp/dT)/d^2, dh/dT = cv + (dp/dT)/d,
+    dh/dd = du/dd + (dp/dd)/d - p/d^2
+
+  and then combined with the Bridgman relation
+
+    (da/db)_c = (da/dT dc/dd - da/dd dc/dT)/(db/dT dc/dd - db/dd dc/dT)
+
+  Returns false if the state is not a one-phase state with valid cp, cv,
+  beta and kappa, in which case res is left unchanged.
+  @param id Derivative id, see partialDeriv_id
+  @param properties ExternalThermodynamicState property struct
+  @param res Partial derivative
+*/
+bool BaseSolver::partialDeriv_fromState(int id, ExternalThermodynamicState *const properties, double &res){
+	if (id < 0 || id >= nDerivProperties*nDerivProperties*nDerivProperties)
+		return false;
+	const double T = properties->T, d = properties->d, p = properties->p;
+	const double cv = properties->cv, beta = properties->beta, kappa = properties->kappa;
+	if (properties->phase != 1 || ISNAN(properties->cp) || ISNAN(cv) || ISNAN(beta) || ISNAN(kappa) ||
+		kappa == 0.0 || d == 0.0 || T == 0.0)
+		return false;
+
+	// Derivatives wrt T at constant d and wrt d at constant T, in the order of derivProperties
+	double dpdT = beta/kappa;
+	double dpdd = 1/(d*kappa);
+	double dudd = (p - T*dpdT)/(d*d);
+	double dT[nDerivProperties] = {dpdT, 1.0, 0.0, cv + dpdT/d, cv/T, cv};
+	double dd[nDerivProperties] = {dpdd, 0.0, 1.0, dudd + dpdd/d - p/(d*d), -beta/(kappa*d*d), dudd};
+
+	int iCst = id % nDerivProperties;
+	int iWrt = (id / nDerivProperties) % nDerivProperties;
+	int iOf = id / (nDerivProperties*nDerivProperties);
+	double den = dT[iWrt]*dd[iCst] - dd[iWrt]*dT[iCst];
+	if (den == 0.0)
+		return false;
+	res = (dT[iOf]*dd[iCst] - dd[iOf]*dT[iCst])/den;
+	return true;
+}
+
 //! Compute Prandtl number
 /*!
   This function returns the Prandtl number
@@ -408,6 +1086,20 @@ double BaseSolver::d_der(ExternalThermodynamicState *const properties){
 	return 0;
 }
 
+//! Compute total derivative of density pT
+/*!
+  This function returns the total derivative of density pT from the
+  isothermal compressibility and the isobaric expansion coefficient of
+  the state specified by the properties input, without a new state
+  computation.
+  @param properties ExternalThermodynamicState property struct corresponding to current state
+  @param p_der Time derivative of pressure
+  @param T_der Time derivative of temperature
+*/
+double BaseSolver::d_der_pT(ExternalThermodynamicState *const properties, double p_der, double T_der){
+	return properties->d*(properties->kappa*p_der - properties->beta*T_der);
+}
+
 //! Compute isentropic enthalpy
 /*!
   This function returns the enthalpy at pressure p after an isentropic
@@ -451,6 +1143,58 @@ void BaseSolver::setSat_T(double &T, ExternalSaturationProperties *const propert
 	errorMessage((char*)"Internal error: setSat_T() not implemented in the Solver object");
 }
 
+//! Compute saturation properties for an array of inputs
+/*!
+  This function computes the saturation properties for n pressures or
+  temperatures. The default implementation calls setSat_p or setSat_T
+  for each element.
+  @param byPressure True if the inputs are pressures, false if they are temperatures
+  @param n Number of elements
+  @param input Array of pressures or temperatures
+  @param properties Array of ExternalSaturationProperties property structs
+*/
+void BaseSolver::setSats(bool byPressure, int n, const double *input, ExternalSaturationProperties *const properties){
+	for (int i = 0; i < n; i++){
+		double in = input[i];
+		if (byPressure)
+			setSat_p(in, properties + i);
+		else
+			setSat_T(in, properties + i);
+	}
+}
+
+//! Set saturation properties at the pressure of a state
+/*!
+  This function sets the saturation properties at the pressure of the
+  given state. Records recently computed for the same pressure, e.g. by the
+  setState_xx_sat functions, are reused without a new computation.
+  @param properties ExternalThermodynamicState property struct
+  @param satProperties ExternalSaturationProperties property struct
+*/
+void BaseSolver::setSat_p_state(ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties){
+	if (findSaturationProperties(true, properties->p, satProperties))
+		return;
+	setSat_p(properties->p, satProperties);
+	storeSaturationProperties(true, properties->p, *satProperties);
+}
+
+//! Set saturation properties at the temperature of a state
+/*!
+  This function sets the saturation properties at the temperature of the
+  given state. Two-phase states are at saturation, so a record computed for
+  their pressure is valid as well.
+  @param properties ExternalThermodynamicState property struct
+  @param satProperties ExternalSaturationProperties property struct
+*/
+void BaseSolver::setSat_T_state(ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties){
+	if (findSaturationProperties(false, properties->T, satProperties))
+		return;
+	if (properties->phase == 2 && findSaturationProperties(true, properties->p, satProperties))
+		return;
+	setSat_T(properties->T, satProperties);
+	storeSaturationProperties(false, properties->T, *satProperties);
+}
+
 //! Set bubble state
 /*!
   This function sets the bubble state record bubbleProperties corresponding to the
@@ -712,3 +1456,332 @@ double BaseSolver::Tsat(ExternalSaturationProperties *const properties){
 	return 0;
 }
 
+//! Select the flash history slot of the calling thread
+/*!
+  Implicit integrators evaluate the same medium at many different
+  locations of a model. Callers can give each location its own slot, so
+  that every flash is warm started from the last solution obtained at
+  the same location. The slot belongs to the current call of the calling
+  thread, like the property mask: it is reset to the default slot 0 at the
+  start of the next call, see resetCallOptions().
+  @param slot Caller-defined slot id
+*/
+void BaseSolver::setFlashSlot(int slot){
+	currentFlashSlot = slot;
+}
+
+//! Set the property mask
+/*!
+  This function selects the properties that the following setState calls
+  of the calling thread have to compute, as a combination of the
+  PROPERTY_xx flags defined in externalmedialib.h. Pressure, temperature,
+  density, specific enthalpy, specific entropy and phase are always
+  computed. Solvers are free to compute more than requested.
+
+  The mask belongs to the current call of the calling thread: it is reset
+  to PROPERTY_ALL by resetCallOptions() at the start of the next call, so
+  a call ended by an error does not leave it reduced.
+  @param mask Property mask
+*/
+void BaseSolver::setPropertyMask(int mask){
+	currentPropertyMask = mask;
+}
+
+//! Reset the options of the current call of the calling thread
+/*!
+  Called by SolverMap::getSolver() at the start of every call of the
+  library. The error function of the Modelica tool does not return, so
+  options set for a single call cannot be restored at its end.
+*/
+void BaseSolver::resetCallOptions(){
+	currentPropertyMask = PROPERTY_ALL;
+	currentFlashSlot = 0;
+}
+
+//! Return the property mask of the calling thread
+int BaseSolver::propertyMask(){
+	return currentPropertyMask;
+}
+
+//! Flag the properties outside the mask as not computed
+/*!
+  This function sets all the properties of the state record that are not
+  selected by the mask to NAN.
+  @param mask Property mask
+  @param properties ExternalThermodynamicState property struct
+*/
+void BaseSolver::applyPropertyMask(int mask, ExternalThermodynamicState *const properties){
+	if (!(mask & PROPERTY_cp))     properties->cp = NAN;
+	if (!(mask & PROPERTY_cv))     properties->cv = NAN;
+	if (!(mask & PROPERTY_a))      properties->a = NAN;
+	if (!(mask & PROPERTY_beta))   properties->beta = NAN;
+	if (!(mask & PROPERTY_kappa))  properties->kappa = NAN;
+	if (!(mask & PROPERTY_ddhp))   properties->ddhp = NAN;
+	if (!(mask & PROPERTY_ddph))   properties->ddph = NAN;
+	if (!(mask & PROPERTY_eta))    properties->eta = NAN;
+	if (!(mask & PROPERTY_lambda)) properties->lambda = NAN;
+}
+
+//! Return the solver statistics
+SolverStatistics BaseSolver::statistics(){
+	ScopedLock lock(_threadContextsMutex);
+	return _statistics;
+}
+
+//! Count a state update in the solver statistics
+/*!
+  Called on every state update, so the counters are incremented
+  atomically instead of under the solver lock.
+  @param table True if the state was computed from look-up tables, false
+  if it was computed from the equation of state
+*/
+void BaseSolver::countEvaluation(bool table){
+	if (table)
+		atomicIncrement(&_statistics.tableEvaluations);
+	else
+		atomicIncrement(&_statistics.exactEvaluations);
+}
+
+//! Return the table filled on first access used by the solver
+/*!
+  The default implementation returns NULL, for solvers without such a
+  table, see tiledtable.h.
+*/
+TiledTable *BaseSolver::tiledTable(){
+	return NULL;
+}
+
+//! Estimate the memory used by the solver in bytes
+/*!
+  The default implementation counts the solver object, the names and the
+  per-thread call contexts with their flash history. Derived classes add
+  the memory owned by the external library objects they allocate.
+*/
+size_t BaseSolver::memoryUsage(){
+	// Approximate size of the bookkeeping data of a map node
+	const size_t nodeOverhead = 4*sizeof(void*);
+	size_t bytes = sizeof(BaseSolver) + mediumName.capacity() + libraryName.capacity() + substanceName.capacity();
+	ScopedLock lock(_threadContextsMutex);
+	for (map<unsigned long, ThreadContext>::const_iterator it = _threadContexts.begin(); it != _threadContexts.end(); ++it)
+		bytes += nodeOverhead + sizeof(*it) +
+			it->second.solutions.size()*(nodeOverhead + sizeof(std::pair<std::pair<int, int>, FlashSolution>));
+	return bytes;
+}
+
+//! Get initial guess for an iterative flash
+/*!
+  This function looks up the last converged solution obtained by the
+  calling thread in the current slot for the same pair of inputs. If the
+  new inputs are within the relative distance _warmStartTolerance of the
+  previous ones, the previous temperature and density are returned as
+  initial guess and true is returned. Otherwise, T0 and d0 are left
+  unchanged and the flash has to be started cold.
+
+  When the caller knows that the previous flash was computed for a
+  neighbouring point, e.g. the previous cell of a discretized pipe, the
+  distance check is skipped.
+
+  The function also updates the warm/cold flash counters.
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param input1 First input of the flash
+  @param input2 Second input of the flash
+  @param neighbour True if the previous flash was computed for a neighbouring point
+  @param T0 Initial guess for the temperature
+  @param d0 Initial guess for the density
+*/
+bool BaseSolver::flashGuess(int inputChoice, double input1, double input2, bool neighbour, double &T0, double &d0){
+	ScopedLock lock(_threadContextsMutex);
+	if (_warmStartTolerance > 0){
+		ThreadContext &history = threadContext();
+		map<std::pair<int, int>, FlashSolution>::const_iterator it =
+			history.solutions.find(std::make_pair(currentFlashSlot, inputChoice));
+		if (it != history.solutions.end()){
+			const FlashSolution &sol = it->second;
+			// Inputs may be negative or zero (h, s), hence the absolute scale of 1
+			if (neighbour ||
+				(fabs(input1 - sol.input1) <= _warmStartTolerance*(fabs(sol.input1) + 1.0) &&
+				 fabs(input2 - sol.input2) <= _warmStartTolerance*(fabs(sol.input2) + 1.0))){
+				T0 = sol.T;
+				d0 = sol.d;
+				_statistics.warmFlashes++;
+				return true;
+			}
+		}
+	}
+	_statistics.coldFlashes++;
+	return false;
+}
+
+//! Store converged flash solution
+/*!
+  This function stores the solution of a flash in the history of the
+  calling thread, to be used as initial guess by flashGuess().
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param input1 First input of the flash
+  @param input2 Second input of the flash
+  @param T Converged temperature
+  @param d Converged density
+*/
+void BaseSolver::storeFlashSolution(int inputChoice, double input1, double input2, double T, double d){
+	if (_warmStartTolerance <= 0)
+		return;
+	ScopedLock lock(_threadContextsMutex);
+	ThreadContext &history = threadContext();
+	std::pair<int, int> key(currentFlashSlot, inputChoice);
+	// The history is bounded, since callers may use any number of slots
+	if (history.solutions.size() >= MAX_FLASH_SOLUTIONS && history.solutions.find(key) == history.solutions.end())
+		history.solutions.clear();
+	FlashSolution &sol = history.solutions[key];
+	sol.input1 = input1;
+	sol.input2 = input2;
+	sol.T = T;
+	sol.d = d;
+}
+
+//! Return the call context of the calling thread, created on first use
+/*!
+  Must be called with _threadContextsMutex locked. Threads may come and go
+  during a simulation (e.g. the threads of a co-simulation master), and
+  their contexts cannot be removed when they end, so at most
+  MAX_THREAD_CONTEXTS contexts are kept: a new thread replaces the context
+  used least recently.
+*/
+BaseSolver::ThreadContext &BaseSolver::threadContext(){
+	unsigned long id = currentThreadId();
+	map<unsigned long, ThreadContext>::iterator it = _threadContexts.find(id);
+	if (it == _threadContexts.end()){
+		if (_threadContexts.size() >= MAX_THREAD_CONTEXTS){
+			map<unsigned long, ThreadContext>::iterator oldest = _threadContexts.begin();
+			for (map<unsigned long, ThreadContext>::iterator other = _threadContexts.begin(); other != _threadContexts.end(); ++other)
+				if (other->second.lastUse < oldest->second.lastUse)
+					oldest = other;
+			_threadContexts.erase(oldest);
+		}
+		it = _threadContexts.insert(std::make_pair(id, ThreadContext())).first;
+	}
+	it->second.lastUse = ++_threadContextsUses;
+	return it->second;
+}
+
+//! Set a state on the saturation boundary
+/*!
+  This function sets the bubble (liquid = true) or dew (liquid = false) state
+  record corresponding to the saturation data contained in the properties
+  record, without running a flash.
+
+  The state is assembled from the saturated phase state belonging to the
+  saturation record, which is computed once by setSaturatedState() and then
+  cached. The one-sided derivatives of the density are computed
+  analytically: on the one-phase side from cp, beta and kappa of the
+  saturated phase, on the two-phase side from the lever rule applied to the
+  saturation line derivatives.
+
+  On the two-phase side, the remaining properties (cp, cv, a, beta, kappa,
+  eta, lambda) are those of the saturated phase.
+  @param properties ExternalSaturationProperties record with saturation properties data
+  @param liquid True for the bubble state, false for the dew state
+  @param phase Phase (1: one-phase, 2: two-phase, 0: two-phase side)
+  @param boundaryProperties ExternalThermodynamicState record where to write the properties
+*/
+void BaseSolver::setSaturationBoundaryState(ExternalSaturationProperties *const properties, bool liquid, int phase,
+		                                    ExternalThermodynamicState *const boundaryProperties){
+	int side = liquid ? 0 : 1;
+	bool cached = false;
+	{
+		ScopedLock lock(_saturatedStatesMutex);
+		SaturatedStates *entry = findSaturatedStates(properties);
+		if (entry != NULL && entry->valid[side]){
+			*boundaryProperties = entry->states[side];
+			cached = true;
+		}
+	}
+	if (!cached){
+		setSaturatedState(properties, liquid, boundaryProperties);
+		storeSaturatedState(properties, liquid, *boundaryProperties);
+	}
+
+	// The saturation record is the reference for the boundary values
+	ExternalThermodynamicState *const state = boundaryProperties;
+	state->p = properties->psat;
+	state->T = properties->Tsat;
+	state->d = liquid ? properties->dl : properties->dv;
+	state->h = liquid ? properties->hl : properties->hv;
+
+	if (phase == 1){
+		// One-phase side: derivatives of d(T(p,h),p) of the saturated phase
+		state->ddhp = -state->d*state->beta/state->cp;
+		state->ddph = state->d*state->kappa - state->beta*(state->T*state->beta - 1)/state->cp;
+		state->phase = 1;
+	}
+	else{
+		// Two-phase side: lever rule v = vl + x*(vv - vl), x = (h - hl)/(hv - hl)
+		double x = liquid ? 0.0 : 1.0;
+		double vl = 1/properties->dl;
+		double vv = 1/properties->dv;
+		double dvldp = -properties->ddldp/(properties->dl*properties->dl);
+		double dvvdp = -properties->ddvdp/(properties->dv*properties->dv);
+		double dxdp = -(properties->dhldp + x*(properties->dhvdp - properties->dhldp))/(properties->hv - properties->hl);
+		double dvdp = dvldp + x*(dvvdp - dvldp) + (vv - vl)*dxdp;
+		state->ddhp = -state->d*state->d*(vv - vl)/(properties->hv - properties->hl);
+		state->ddph = -state->d*state->d*dvdp;
+		state->phase = 2;
+	}
+}
+
+//! Compute a saturated phase state
+/*!
+  This function computes the properties of the saturated liquid
+  (liquid = true) or saturated vapour (liquid = false) phase belonging to
+  the saturation record. The default implementation evaluates the equation
+  of state directly at the saturation temperature and the density of the
+  phase, with a one-phase hint. Can be overridden in the specific solver code
+  if the saturated phase properties are available more efficiently.
+  @param properties ExternalSaturationProperties record with saturation properties data
+  @param liquid True for the saturated liquid, false for the saturated vapour
+  @param saturatedProperties ExternalThermodynamicState record where to write the properties
+*/
+void BaseSolver::setSaturatedState(ExternalSaturationProperties *const properties, bool liquid,
+		                           ExternalThermodynamicState *const saturatedProperties){
+	double d = liquid ? properties->dl : properties->dv;
+	int phase = 1;
+	setState_dT(d, properties->Tsat, phase, saturatedProperties);
+}
+
+//! Store a saturated phase state in the cache
+/*!
+  This function stores the saturated liquid or vapour state belonging to
+  a saturation record, so that the bubble and dew states of that record can
+  be assembled without further property computations. Solvers whose
+  setSat_p/setSat_T already evaluate the saturated phases can call this
+  function to fill the cache.
+  @param properties ExternalSaturationProperties record with saturation properties data
+  @param liquid True for the saturated liquid, false for the saturated vapour
+  @param saturatedProperties Saturated phase state
+*/
+void BaseSolver::storeSaturatedState(ExternalSaturationProperties *const properties, bool liquid,
+		                             const ExternalThermodynamicState &saturatedProperties){
+	ScopedLock lock(_saturatedStatesMutex);
+	SaturatedStates *entry = findSaturatedStates(properties);
+	if (entry == NULL){
+		entry = &_saturatedStates[_saturatedStatesNext];
+		_saturatedStatesNext = (_saturatedStatesNext + 1) % SATURATED_STATES_CACHE_SIZE;
+		entry->psat = properties->psat;
+		entry->Tsat = properties->Tsat;
+		entry->valid[0] = false;
+		entry->valid[1] = false;
+	}
+	int side = liquid ? 0 : 1;
+	entry->states[side] = saturatedProperties;
+	entry->valid[side] = true;
+}
+
+//! Find the cache entry of a saturation record (caller must hold the lock)
+BaseSolver::SaturatedStates *BaseSolver::findSaturatedStates(ExternalSaturationProperties *const properties){
+	for (int i = 0; i < SATURATED_STATES_CACHE_SIZE; i++){
+		SaturatedStates &entry = _saturatedStates[i];
+		if ((entry.valid[0] || entry.valid[1]) &&
+			entry.psat == properties->psat && entry.Tsat == properties->Tsat)
+			return &entry;
+	}
+	return NULL;
+}
@@ -4,11 +4,30 @@
 #include "include.h"
 #include "fluidconstants.h"
 #include "externalmedialib.h"
+#include "threading.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 struct FluidConstants;
+class TiledTable;
+
+//! Solver statistics
+/*!
+  Counters collected by the solver to measure the effect of the
+  performance optimisations, e.g. the warm start of the iterative
+  flash routines.
+*/
+struct SolverStatistics{
+	//! Number of flashes started without an initial guess
+	long coldFlashes;
+	//! Number of flashes started from a previously converged solution
+	long warmFlashes;
+	//! Number of state updates computed from look-up tables
+	long tableEvaluations;
+	//! Number of state updates computed from the equation of state
+	long exactEvaluations;
+};
 
 //! Base solver class.
 /*!
@@ -36,6 +55,8 @@ public:
 	double criticalEntropy() const;
 
 	virtual void setFluidConstants();
+	virtual void prepare();
+	virtual bool isReentrant();
 
 	virtual void setState_ph(double &p, double &h, int &phase, ExternalThermodynamicState *const properties);
 	virtual void setState_pT(double &p, double &T, ExternalThermodynamicState *const properties);
@@ -43,7 +64,29 @@ public:
 	virtual void setState_ps(double &p, double &s, int &phase, ExternalThermodynamicState *const properties);
 	virtual void setState_hs(double &h, double &s, int &phase, ExternalThermodynamicState *const properties);
 
+	virtual void setState_ph_sat(double &p, double &h, int &phase, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties);
+	virtual void setState_pT_sat(double &p, double &T, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties);
+	virtual void setState_dT_sat(double &d, double &T, int &phase, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties);
+	virtual void setState_ps_sat(double &p, double &s, int &phase, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties);
+	virtual void setState_hs_sat(double &h, double &s, int &phase, ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties);
+
+	virtual void setStates(int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+		                   bool ordered, ExternalThermodynamicState *const properties);
+	virtual void setStates_arrays(int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+		                          bool ordered, const ExternalThermodynamicStateArrays &properties);
+	static int arraysPropertyMask(const ExternalThermodynamicStateArrays &properties);
+
+	void setState_der(int inputChoice, double &input1, double &input2, int &phase, double input1_der, double input2_der,
+		              ExternalThermodynamicState *const derivatives);
+	void setState_sat_der(int inputChoice, double &input1, double &input2, int &phase, double input1_der, double input2_der,
+		                  ExternalThermodynamicState *const derivatives, ExternalSaturationProperties *const satDerivatives);
+	void setState_jac(int inputChoice, double &input1, double &input2, int &phase, ExternalThermodynamicState *const properties,
+		              ExternalThermodynamicState *const derivatives1, ExternalThermodynamicState *const derivatives2);
+	void storeLastState(int inputChoice, double input1, double input2, int phase, const ExternalThermodynamicState &properties);
+
 	virtual double partialDeriv_state(const string &of, const string &wrt, const string &cst, ExternalThermodynamicState *const properties);
+	static int partialDeriv_id(const string &of, const string &wrt, const string &cst);
+	virtual double partialDeriv_state_id(int id, ExternalThermodynamicState *const properties);
 
 	virtual double Pr(ExternalThermodynamicState *const properties);
 	virtual double T(ExternalThermodynamicState *const properties);
@@ -62,10 +105,14 @@ public:
 	virtual int phase(ExternalThermodynamicState *const properties);
 	virtual double s(ExternalThermodynamicState *const properties);
 	virtual double d_der(ExternalThermodynamicState *const properties);
+	virtual double d_der_pT(ExternalThermodynamicState *const properties, double p_der, double T_der);
 	virtual double isentropicEnthalpy(double &p, ExternalThermodynamicState *const properties);
 
 	virtual void setSat_p(double &p, ExternalSaturationProperties *const properties);
 	virtual void setSat_T(double &T, ExternalSaturationProperties *const properties);
+	virtual void setSats(bool byPressure, int n, const double *input, ExternalSaturationProperties *const properties);
+	virtual void setSat_p_state(ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties);
+	virtual void setSat_T_state(ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties);
 
 	virtual void setBubbleState(ExternalSaturationProperties *const properties, int phase,
 		                    ExternalThermodynamicState *const bubbleProperties);
@@ -90,6 +137,14 @@ public:
 	virtual double psat(ExternalSaturationProperties *const properties);
 	virtual double Tsat(ExternalSaturationProperties *const properties);
 
+	void setFlashSlot(int slot);
+	void setPropertyMask(int mask);
+	static void resetCallOptions();
+	static void applyPropertyMask(int mask, ExternalThermodynamicState *const properties);
+	SolverStatistics statistics();
+	virtual size_t memoryUsage();
+	virtual TiledTable *tiledTable();
+
 	//! Medium name
 	string mediumName;
 	//! Library name
@@ -98,8 +153,94 @@ public:
 	string substanceName;
 
 protected:
-	//! Fluid constants
+	void initFluidConstants() const;
+	int propertyMask();
+	bool partialDeriv_fromState(int id, ExternalThermodynamicState *const properties, double &res);
+	virtual void propertyDerivatives_dT(ExternalThermodynamicState *const properties, ExternalThermodynamicState *const derivativesT,
+		                                ExternalThermodynamicState *const derivativesD);
+	virtual void setSat_p_newState(ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties);
+	bool findSaturationProperties(bool byPressure, double input, ExternalSaturationProperties *const satProperties);
+	void storeSaturationProperties(bool byPressure, double input, const ExternalSaturationProperties &satProperties);
+	bool flashGuess(int inputChoice, double input1, double input2, bool neighbour, double &T0, double &d0);
+	void storeFlashSolution(int inputChoice, double input1, double input2, double T, double d);
+	void countEvaluation(bool table);
+
+	void setSaturationBoundaryState(ExternalSaturationProperties *const properties, bool liquid, int phase,
+		                            ExternalThermodynamicState *const boundaryProperties);
+	virtual void setSaturatedState(ExternalSaturationProperties *const properties, bool liquid,
+		                           ExternalThermodynamicState *const saturatedProperties);
+	void storeSaturatedState(ExternalSaturationProperties *const properties, bool liquid,
+		                     const ExternalThermodynamicState &saturatedProperties);
+
+	//! Fluid constants, see initFluidConstants
 	FluidConstants _fluidConstants;
+	//! Set when the fluid constants have been computed
+	mutable OnceFlag _fluidConstantsOnce;
+	//! Relative distance of the inputs below which a flash is warm started (0 disables)
+	double _warmStartTolerance;
+	//! Solver statistics
+	SolverStatistics _statistics;
+
+private:
+	//! Converged flash solution, used as initial guess for the next flash
+	struct FlashSolution{
+		double input1;
+		double input2;
+		double T;
+		double d;
+	};
+	//! Call context of a single thread: last state and flash history
+	struct ThreadContext{
+		ThreadContext() : lastUse(0), lastInputChoice(0), lastInput1(NAN), lastInput2(NAN), lastPhase(-1), lastState(){}
+		//! Value of _threadContextsUses at the last use, see threadContext
+		unsigned long lastUse;
+		//! Inputs and result of the last setState call, see storeLastState
+		int lastInputChoice;
+		double lastInput1;
+		double lastInput2;
+		int lastPhase;
+		ExternalThermodynamicState lastState;
+		//! Flash solutions keyed by slot and input choice
+		map<std::pair<int, int>, FlashSolution> solutions;
+	};
+	//! Maximum number of call contexts and of flash solutions per context
+	enum { MAX_THREAD_CONTEXTS = 64, MAX_FLASH_SOLUTIONS = 1024 };
+	//! Call contexts of all calling threads, keyed by thread id
+	map<unsigned long, ThreadContext> _threadContexts;
+	//! Number of uses of the call contexts, to find the least recently used one
+	unsigned long _threadContextsUses;
+	Mutex _threadContextsMutex;
+	ThreadContext &threadContext();
+	void recallState(int inputChoice, double &input1, double &input2, int &phase, ExternalThermodynamicState *const properties);
+
+	//! Saturated liquid and vapour states belonging to one saturation record
+	struct SaturatedStates{
+		double psat;
+		double Tsat;
+		bool valid[2];
+		ExternalThermodynamicState states[2];
+	};
+	//! Number of saturation records kept in the cache
+	enum { SATURATED_STATES_CACHE_SIZE = 8 };
+	//! Cache of saturated states, used as a ring buffer
+	SaturatedStates _saturatedStates[SATURATED_STATES_CACHE_SIZE];
+	int _saturatedStatesNext;
+	Mutex _saturatedStatesMutex;
+	SaturatedStates *findSaturatedStates(ExternalSaturationProperties *const properties);
+
+	//! Saturation properties record, keyed by the pressure or temperature it was computed for
+	struct SaturationRecord{
+		bool valid;
+		bool byPressure;
+		double input;
+		ExternalSaturationProperties properties;
+	};
+	//! Number of saturation records kept in the cache
+	enum { SATURATION_CACHE_SIZE = 8 };
+	//! Cache of saturation properties records, used as a ring buffer
+	SaturationRecord _saturationRecords[SATURATION_CACHE_SIZE];
+	int _saturationRecordsNext;
+	Mutex _saturationRecordsMutex;
 };
 
 #endif // BASESOLVER_H_
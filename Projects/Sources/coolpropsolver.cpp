@@ -1,4 +1,7 @@
 #include "coolpropsolver.h"
+#include "fluidcache.h"
+#include "fluidtable.h"
+#include "tiledtable.h"
 #include "CoolPropTools.h"
 #include "CoolPropDLL.h"
 #include "CoolProp.h"
@@ -6,12 +9,67 @@
 #include <iostream>
 #include <string>
 #include <stdlib.h>
+#include <math.h>
 
 //double _p_eps   ; // relative tolerance margin for subcritical pressure conditions
 //double _T_eps   ; // relative tolerance margin for supercritical temperature conditions
-//double _delta_h ; // delta_h for one-phase/two-phase discrimination
 //ExternalSaturationProperties *_satPropsClose2Crit; // saturation properties close to  critical conditions
 
+static SharedTables *sharedTablesOf(const string &fluidName);
+static void releaseSharedTables(SharedTables *tables);
+
+//! True if a boolean option value is set, see checkOption
+static bool isTrue(const std::string &value){
+	return !value.compare("1") || !value.compare("true");
+}
+
+//! Check an option of the substance name
+/*!
+  Returns an empty string if the option is known and its value valid,
+  otherwise the error message. The constructor relies on this check
+  before it reads the value.
+  @param option Option in the form param=value
+*/
+static std::string checkOption(const std::string &option){
+	std::vector<std::string> param_val = strsplit(option,'=');
+	if (param_val.size() != 2)
+		return format("Could not parse the option [%s], must be in the form param=value",option.c_str());
+	const std::string &name = param_val[0];
+	const std::string &value = param_val[1];
+	double number = strtod(value.c_str(),NULL);
+	if (!name.compare("enable_TTSE") || !name.compare("enable_BICUBIC") || !name.compare("calc_transport") ||
+		!name.compare("background_tables") || !name.compare("enable_tiles") || !name.compare("enable_EXTTP"))
+	{
+		if (isTrue(value) || !value.compare("0") || !value.compare("false"))
+			return "";
+		return format("I don't know how to handle this option [%s]",option.c_str());
+	}
+	else if (!name.compare("tiles_dlogp"))
+	{
+		if (number <= 0 || number > 1)
+			return format("I don't know how to handle this tiles_dlogp value [%s]",value.c_str());
+	}
+	else if (!name.compare("tiles_dh") || !name.compare("tiles_tolerance"))
+	{
+		if (number <= 0)
+			return format("I don't know how to handle this %s value [%s]",name.c_str(),value.c_str());
+	}
+	else if (!name.compare("twophase_derivsmoothing_xend") || !name.compare("rho_smoothing_xend") || !name.compare("warmstart_tol"))
+	{
+		if (number < 0 || number > 1)
+			return format("I don't know how to handle this %s value [%s]",name.c_str(),value.c_str());
+	}
+	else if (!name.compare("debug"))
+	{
+		long level = strtol(value.c_str(),NULL,0);
+		if (level < 0 || level > 1000)
+			return format("I don't know how to handle this debug level [%s]",value.c_str());
+	}
+	else
+		return format("This option [%s] was not understood",option.c_str());
+	return "";
+}
+
 CoolPropSolver::CoolPropSolver(const std::string &mediumName, const std::string &libraryName, const std::string &substanceName)
 	: BaseSolver(mediumName, libraryName, substanceName){
 
@@ -23,6 +81,15 @@ CoolPropSolver::CoolPropSolver(const std::string &mediumName, const std::string
 	fluidType       = -1;
 	enable_TTSE     = false;
 	enable_BICUBIC  = false;
+	background_tables = false;
+	enable_tiles    = false;
+	tiles_dlogp     = 0.01;
+	tiles_dh        = 1000;
+	tiles_tolerance = 1e-3;
+	_tiles          = NULL;
+	_sharedTables   = NULL;
+	_criticalBand   = NULL;
+	_splineState    = NULL;
 	debug_level     = 0;
 	calc_transport  = true;
 	extend_twophase = true;
@@ -31,95 +98,52 @@ CoolPropSolver::CoolPropSolver(const std::string &mediumName, const std::string
 
 	// Initialise the saturation and near-critical variables
 	_p_eps   = 1e-3; // relative tolerance margin for subcritical pressure conditions
-	_delta_h = 1e-1; // delta_h for one-phase/two-phase discrimination
 
 	if (name_options.size()>1)
 	{
 		for (unsigned int i = 1; i<name_options.size(); i++)
 		{
-			// Split around the equals sign
-			std::vector<std::string> param_val = strsplit(name_options[i],'=');
-			if (param_val.size() != 2)
-			{
-				errorMessage((char*)format("Could not parse the option [%s], must be in the form param=value",name_options[i].c_str()).c_str());
-			}
+			std::string error = checkOption(name_options[i]);
+			if (!error.empty())
+				errorMessage((char*)error.c_str());
 
-			// Check each of the options in turn
+			// Split around the equals sign, the value is valid
+			std::vector<std::string> param_val = strsplit(name_options[i],'=');
 			if (!param_val[0].compare("enable_TTSE"))
 			{
-				if (!param_val[1].compare("1") || !param_val[1].compare("true"))
-				{
-					std::cout << "TTSE is on\n";
-					enable_TTSE = true;
-				}
-				else if (!param_val[1].compare("0") || !param_val[1].compare("false"))
-				{
-					std::cout << "TTSE is off\n";
-					enable_TTSE = false;
-				}
-				else
-					errorMessage((char*)format("I don't know how to handle this option [%s]",name_options[i].c_str()).c_str());
-					//throw NotImplementedError((char*)format("I don't know how to handle this option [%s]",name_options[i].c_str()).c_str());
+				enable_TTSE = isTrue(param_val[1]);
+				std::cout << (enable_TTSE ? "TTSE is on\n" : "TTSE is off\n");
 			}
 			else if (!param_val[0].compare("enable_BICUBIC"))
 			{
-				if (!param_val[1].compare("1") || !param_val[1].compare("true"))
-				{
-					std::cout << "BICUBIC is on\n";
-					enable_BICUBIC = true;
-				}
-				else if (!param_val[1].compare("0") || !param_val[1].compare("false"))
-				{
-					std::cout << "BICUBIC is off\n";
-					enable_BICUBIC = false;
-				}
-				else
-					errorMessage((char*)format("I don't know how to handle this option [%s]",name_options[i].c_str()).c_str());
-					//throw NotImplementedError((char*)format("I don't know how to handle this option [%s]",name_options[i].c_str()).c_str());
+				enable_BICUBIC = isTrue(param_val[1]);
+				std::cout << (enable_BICUBIC ? "BICUBIC is on\n" : "BICUBIC is off\n");
 			}
 			else if (!param_val[0].compare("calc_transport"))
-			{
-				if (!param_val[1].compare("1") || !param_val[1].compare("true"))
-					calc_transport = true;
-				else if (!param_val[1].compare("0") || !param_val[1].compare("false"))
-					calc_transport = false;
-				else
-					errorMessage((char*)format("I don't know how to handle this option [%s]",name_options[i].c_str()).c_str());
-			}
+				calc_transport = isTrue(param_val[1]);
+			else if (!param_val[0].compare("background_tables"))
+				background_tables = isTrue(param_val[1]);
+			else if (!param_val[0].compare("enable_tiles"))
+				enable_tiles = isTrue(param_val[1]);
+			else if (!param_val[0].compare("tiles_dlogp"))
+				tiles_dlogp = strtod(param_val[1].c_str(),NULL);
+			else if (!param_val[0].compare("tiles_dh"))
+				tiles_dh = strtod(param_val[1].c_str(),NULL);
+			else if (!param_val[0].compare("tiles_tolerance"))
+				tiles_tolerance = strtod(param_val[1].c_str(),NULL);
 			else if (!param_val[0].compare("enable_EXTTP"))
-			{
-				if (!param_val[1].compare("1") || !param_val[1].compare("true"))
-					extend_twophase = true;
-				else if (!param_val[1].compare("0") || !param_val[1].compare("false"))
-					extend_twophase = false;
-				else
-					errorMessage((char*)format("I don't know how to handle this option [%s]",name_options[i].c_str()).c_str());
-			}
+				extend_twophase = isTrue(param_val[1]);
 			else if (!param_val[0].compare("twophase_derivsmoothing_xend"))
-			{
 				twophase_derivsmoothing_xend = strtod(param_val[1].c_str(),NULL);
-				if (twophase_derivsmoothing_xend<0 || twophase_derivsmoothing_xend > 1)
-					errorMessage((char*)format("I don't know how to handle this twophase_derivsmoothing_xend value [%d]",param_val[0].c_str()).c_str());
-			}
 			else if (!param_val[0].compare("rho_smoothing_xend"))
-			{
 				rho_smoothing_xend = strtod(param_val[1].c_str(),NULL);
-				if (rho_smoothing_xend<0 || rho_smoothing_xend > 1)
-					errorMessage((char*)format("I don't know how to handle this rho_smoothing_xend value [%d]",param_val[0].c_str()).c_str());
-			}
+			else if (!param_val[0].compare("warmstart_tol"))
+				_warmStartTolerance = strtod(param_val[1].c_str(),NULL);
 			else if (!param_val[0].compare("debug"))
 			{
 				debug_level = (int)strtol(param_val[1].c_str(),NULL,0);
-				if (debug_level<0 || debug_level > 1000) {
-					errorMessage((char*)format("I don't know how to handle this debug level [%s]",param_val[0].c_str()).c_str());
-				} else {
-					// TODO: Fix this segmentation fault!
-					//set_debug_level(debug_level);
-				}
-			}
-			else
-			{
-				errorMessage((char*)format("This option [%s] was not understood",name_options[i].c_str()).c_str());
+				// TODO: Fix this segmentation fault!
+				//set_debug_level(debug_level);
 			}
 
 			// Some options were passed in, lets see what we have
@@ -130,20 +154,76 @@ CoolPropSolver::CoolPropSolver(const std::string &mediumName, const std::string
 	if (debug_level > 5) std::cout << "Checking fluid " << name_options[0] << " against database." << std::endl;
 	fluidType = getFluidType(name_options[0]); // Throws an error if unknown fluid
 	if (debug_level > 5) std::cout << "Check passed, reducing " << substanceName << " to " << name_options[0] << std::endl;
+	// The cache key holds the full substance name, since the options may
+	// change the computed properties
+	_cacheKey = backendVersion() + "|" + libraryName + "|" + substanceName;
+	_defaultOptions = (name_options.size() == 1);
+	// The tiled table is shared by the solvers with the same options
+	bool saturation = (fluidType==FLUID_TYPE_PURE)||(fluidType==FLUID_TYPE_PSEUDOPURE)||(fluidType==FLUID_TYPE_REFPROP);
+	if (enable_tiles && saturation)
+		_tiles = TiledTable::shared(libraryName + "|" + substanceName, tiles_dlogp, tiles_dh, tiles_tolerance);
 	this->substanceName = name_options[0];
+	if (saturation)
+		_sharedTables = sharedTablesOf(this->substanceName);
 	state = new CoolPropStateClassSI(name_options[0]);
-	this->setFluidConstants();
+	// The fluid constants and the near-critical saturation properties are
+	// computed on first need, see initFluidConstants and initSatPropsClose2Crit
 }
 
 
 CoolPropSolver::~CoolPropSolver(){
+	TiledTable::release(_tiles);
+	CriticalBand::release(_criticalBand);
+	releaseSharedTables(_sharedTables);
 	delete state;
+	delete _splineState;
 	//delete _satPropsClose2Crit;
 };
 
+//! Check a substance name without creating a solver
+/*!
+  Returns an empty string if the base fluid is known and the options are
+  valid, otherwise the error message the constructor would report. Used
+  to skip the invalid entries of the prewarm list, see prewarm.h.
+  @param substanceName Substance name with options, e.g. "Water|enable_TTSE=1"
+*/
+std::string CoolPropSolver::checkSubstanceName(const std::string &substanceName){
+	std::vector<std::string> name_options = strsplit(substanceName,'|');
+	for (unsigned int i = 1; i<name_options.size(); i++)
+	{
+		std::string error = checkOption(name_options[i]);
+		if (!error.empty())
+			return error;
+	}
+	try {
+		getFluidType(name_options[0]);
+	}
+	catch(std::exception &e)
+	{
+		return e.what();
+	}
+	return "";
+}
+
 
 void CoolPropSolver::setFluidConstants(){
 	if ((fluidType==FLUID_TYPE_PURE)||(fluidType==FLUID_TYPE_PSEUDOPURE)||(fluidType==FLUID_TYPE_REFPROP)){
+		const FluidTableEntry *entry = FluidTable::find(backendVersion(), substanceName);
+		if (entry != NULL){
+			_fluidConstants.pc = entry->pc;
+			_fluidConstants.Tc = entry->Tc;
+			_fluidConstants.MM = entry->MM;
+			_fluidConstants.dc = entry->dc;
+			return;
+		}
+		double values[4];
+		if (FluidCache::load(_cacheKey + "|constants", 4, values)){
+			_fluidConstants.pc = values[0];
+			_fluidConstants.Tc = values[1];
+			_fluidConstants.MM = values[2];
+			_fluidConstants.dc = values[3];
+			return;
+		}
 		if (debug_level > 5) std::cout << format("Setting constants for fluid %s \n",substanceName.c_str());
 		_fluidConstants.pc = PropsSI((char *)"pcrit"   ,(char *)"T",0,(char *)"P",0,(char *)substanceName.c_str());
 		_fluidConstants.Tc = PropsSI((char *)"Tcrit"   ,(char *)"T",0,(char *)"P",0,(char *)substanceName.c_str());
@@ -151,11 +231,11 @@ void CoolPropSolver::setFluidConstants(){
 		/* TODO: Fix this dirty, dirty workaround */
 		if (_fluidConstants.MM > 1.0) _fluidConstants.MM *= 1e-3;
 		_fluidConstants.dc = PropsSI((char *)"rhocrit" ,(char *)"T",0,(char *)"P",0,(char *)substanceName.c_str());
-		// Now we fill the close to crit record
-		if (debug_level > 5) std::cout << format("Setting near-critical saturation conditions for fluid %s \n",substanceName.c_str());
-		_satPropsClose2Crit.psat = _fluidConstants.pc*(1.0-_p_eps); // Needs update, setSat_p relies on it
-		setSat_p(_satPropsClose2Crit.psat, &_satPropsClose2Crit);
-
+		values[0] = _fluidConstants.pc;
+		values[1] = _fluidConstants.Tc;
+		values[2] = _fluidConstants.MM;
+		values[3] = _fluidConstants.dc;
+		FluidCache::store(_cacheKey + "|constants", 4, values);
 	}
 	else if ((fluidType==FLUID_TYPE_INCOMPRESSIBLE_LIQUID)||(fluidType==FLUID_TYPE_INCOMPRESSIBLE_SOLUTION)){
 		if (debug_level > 5) std::cout << format("Setting constants for incompressible fluid %s \n",substanceName.c_str());
@@ -167,36 +247,453 @@ void CoolPropSolver::setFluidConstants(){
 }
 
 
-void CoolPropSolver::preStateChange(void) {
-	/// Some common code to avoid pitfalls from incompressibles
+//! Return the CoolProp version, used to validate cached and tabulated fluid data
+std::string CoolPropSolver::backendVersion(){
+	static std::string version("CoolProp " + get_global_param_string("version") + " " + get_global_param_string("gitrevision"));
+	return version;
+}
+
+//! Return the pressure above which the conditions are treated as supercritical
+double CoolPropSolver::psatClose2Crit(){
+	initFluidConstants();
+	return _fluidConstants.pc*(1.0-_p_eps);
+}
+
+//! Compute the saturation properties close to the critical point on first need
+/*!
+  The record is used for supercritical inputs of the saturation functions.
+  It is computed directly by CoolProp at psatClose2Crit(), bypassing the
+  critical band, so that the record does not depend on the band settings
+  and the band is not built for it. Fluids without saturation line get a
+  record that no input exceeds.
+*/
+void CoolPropSolver::initSatPropsClose2Crit(){
+	if (_satPropsClose2CritOnce.done())
+		return;
+	double psat = psatClose2Crit();
+	ExternalSaturationProperties satProperties;
 	if ((fluidType==FLUID_TYPE_PURE)||(fluidType==FLUID_TYPE_PSEUDOPURE)||(fluidType==FLUID_TYPE_REFPROP)){
-		try {
-			if (enable_TTSE)
-				state->enable_TTSE_LUT();
-			else
-				state->disable_TTSE_LUT();
+		// The options may change the saturation properties
+		const FluidTableEntry *entry = _defaultOptions ? FluidTable::find(backendVersion(), substanceName) : NULL;
+		// Records stored by earlier versions may come from the critical band.
+		// The key has no band settings, the record is computed without it
+		string key(_cacheKey + format("|close2crit-direct|%g", _p_eps));
+		if (entry != NULL && entry->p_eps == _p_eps)
+			satProperties = entry->close2Crit;
+		else if (!FluidCache::loadSaturation(key, &satProperties)){
+			if (debug_level > 5) std::cout << format("Setting near-critical saturation conditions for fluid %s \n",substanceName.c_str());
+			this->preStateChange();
+			setSat_p_direct(psat, &satProperties);
+			FluidCache::storeSaturation(key, satProperties);
+		}
+	}
+	else {
+		satProperties.psat = NAN;
+		satProperties.Tsat = NAN;
+	}
+	_satPropsClose2Crit = satProperties;
+	_satPropsClose2CritOnce.setDone();
+}
 
-			if (enable_BICUBIC)
-			{
-				state->enable_TTSE_LUT();
-				state->pFluid->TTSESinglePhase.set_mode(TTSE_MODE_BICUBIC);
+//! Compute the fluid constants, the near-critical saturation properties and the look-up tables
+/*!
+  CoolProp builds the TTSE or bicubic tables of a fluid on the first state
+  update with the tables enabled, which is triggered here by a saturation
+  call at half the critical pressure.
+*/
+void CoolPropSolver::prepare(){
+	BaseSolver::prepare();
+	initSatPropsClose2Crit();
+	initTables();
+}
+
+//! Bits of the options switching the fluid object, see CoolPropSolver::tableOptions
+enum { TABLE_OPTION_TABLES = 1, TABLE_OPTION_BICUBIC = 2, TABLE_OPTION_EXTTP = 4 };
+
+//! Look-up tables of a fluid
+/*!
+  CoolProp keeps the TTSE and bicubic tables in its fluid objects, so they
+  are shared by all the solvers of the same fluid in the process, whatever
+  their options. The first build is serialized here, so that solvers of
+  different contexts or worker threads do not build the same tables at
+  the same time. The fluid object is not thread-safe, so no solver of the
+  fluid enables, disables or configures its tables before they are ready,
+  and the switches of the fluid object are only written under the lock,
+  see setTableOptions.
+*/
+struct SharedTables{
+	Mutex mutex;
+	//! Signalled when a background build ends
+	ConditionVariable buildDone;
+	bool built;
+	bool building;
+	bool failed;
+	//! Set when the tables are built, for the checks without lock
+	OnceFlag ready;
+	//! Options applied to the fluid object, -1 before the first, see CoolPropSolver::tableOptions
+	int applied;
+	//! Options of the first solver of the fluid, those of the reentrant solvers, see CoolPropSolver::isReentrant
+	int options;
+	//! Fluid name and number of users, protected by sharedTablesMutex
+	string fluidName;
+	int references;
+};
+static Mutex sharedTablesMutex;
+static map<string, SharedTables*> sharedTables;
+
+//! Return the shared tables record of a fluid, created on first use
+/*!
+  Each call takes a reference to the record, which must be given back
+  with releaseSharedTables. The tables themselves belong to CoolProp.
+*/
+static SharedTables *sharedTablesOf(const string &fluidName){
+	ScopedLock lock(sharedTablesMutex);
+	map<string, SharedTables*>::iterator it = sharedTables.find(fluidName);
+	if (it != sharedTables.end()){
+		it->second->references++;
+		return it->second;
+	}
+	SharedTables *tables = new SharedTables;
+	tables->built = false;
+	tables->building = false;
+	tables->failed = false;
+	tables->applied = -1;
+	tables->options = -1;
+	tables->fluidName = fluidName;
+	tables->references = 1;
+	sharedTables[fluidName] = tables;
+	return tables;
+}
+
+//! Give back a reference to a shared tables record, deleted with its last reference
+static void releaseSharedTables(SharedTables *tables){
+	if (tables == NULL)
+		return;
+	{
+		ScopedLock lock(sharedTablesMutex);
+		if (--tables->references > 0)
+			return;
+		sharedTables.erase(tables->fluidName);
+	}
+	delete tables;
+}
+
+//! Build the tables of a fluid with the given state object
+/*!
+  The tables are built directly by the fluid object, which leaves them
+  disabled: the solvers of the fluid keep computing their states from the
+  equation of state, without reading the tables being built, until
+  setTableOptions enables them. If the persistent cache is enabled (see
+  fluidcache.h), CoolProp is also told to write the tables to its table
+  directory, from which they are read instead of built in later runs.
+*/
+static void buildTables(CoolPropStateClassSI *state, const string &fluidName){
+	if (!FluidCache::directory().empty())
+		enable_TTSE_LUT_writing((char *)fluidName.c_str());
+	state->pFluid->build_TTSE_LUT();
+}
+
+//! Arguments of a background table build
+struct BackgroundTables{
+	SharedTables *tables;
+	string fluidName;
+};
+
+//! Build the tables of a fluid on a background thread
+/*!
+  Uses its own state object, so that the solvers can go on using theirs
+  without the tables in the meantime. Errors cannot be reported from this
+  thread; the solvers then keep using the equation of state. The thread
+  holds a reference to the shared tables record, released at the end.
+*/
+static void buildTablesInBackground(void *argument){
+	BackgroundTables *build = (BackgroundTables*)argument;
+	bool built = false;
+	try {
+		CoolPropStateClassSI state(build->fluidName);
+		buildTables(&state, build->fluidName);
+		built = true;
+	} catch(std::exception &) {
+	}
+	{
+		ScopedLock lock(build->tables->mutex);
+		build->tables->built = built;
+		build->tables->failed = !built;
+		build->tables->building = false;
+		build->tables->buildDone.notifyAll();
+	}
+	if (built)
+		build->tables->ready.setDone();
+	releaseSharedTables(build->tables);
+	delete build;
+}
+
+//! Build the look-up tables of the fluid if the options enable them
+/*!
+  Normally the tables are built by the calling thread. With the option
+  background_tables=1 the build is started on a background thread
+  instead, and the solver uses the equation of state until the tables
+  are ready; preStateChange() then switches to the tables. The number of
+  state updates served by each path is counted in the solver statistics.
+*/
+void CoolPropSolver::initTables(){
+	bool saturation = (fluidType==FLUID_TYPE_PURE)||(fluidType==FLUID_TYPE_PSEUDOPURE)||(fluidType==FLUID_TYPE_REFPROP);
+	if (!(enable_TTSE || enable_BICUBIC) || !saturation || _tablesOnce.done())
+		return;
+	initFluidConstants();
+	SharedTables *tables = _sharedTables;
+	if (tables->ready.done()){
+		_tablesOnce.setDone();
+		return;
+	}
+
+	char error[1000] = "";
+	{
+		ScopedLock lock(tables->mutex);
+		if (background_tables){
+			if (!tables->built && !tables->building && !tables->failed){
+				BackgroundTables *build = new BackgroundTables;
+				build->tables = sharedTablesOf(substanceName);
+				build->fluidName = substanceName;
+				tables->building = startThread(buildTablesInBackground, build);
+				if (!tables->building){
+					releaseSharedTables(build->tables);
+					delete build;
+				}
 			}
+			// Without a background thread the tables are built below
+			if (tables->building || tables->failed)
+				return;
+		}
+		while (tables->building)
+			tables->buildDone.wait(tables->mutex);
+		if (!tables->built){
+			try {
+				buildTables(state, substanceName);
+				tables->built = true;
+				tables->ready.setDone();
+			} catch(std::exception &e) {
+				// Reported once the lock is released, since the Modelica error function does not return
+				strncpy(error, e.what(), sizeof(error) - 2);
+				error[sizeof(error) - 2] = '\0';
+			}
+		}
+	}
+	if (error[0] != '\0')
+		errorMessage(error);
+	_tablesOnce.setDone();
+}
 
-			if (extend_twophase)
+//! Separate CoolPropSolver objects have separate state objects
+/*!
+  The fluid data shared among the state objects is built lazily on first
+  use; batched calls evaluate their first element on the calling thread
+  before the other workers start, so that it exists by then. The table
+  switches of the shared fluid object are rewritten by the solvers whose
+  options differ from those applied last (see setTableOptions), so only
+  the solvers with the options of the first solver of the fluid are
+  reentrant.
+*/
+bool CoolPropSolver::isReentrant(){
+	if (_sharedTables == NULL)
+		return true;
+	ScopedLock lock(_sharedTables->mutex);
+	if (_sharedTables->options < 0)
+		_sharedTables->options = tableOptions();
+	return _sharedTables->options == tableOptions();
+}
+
+//! Estimate the memory used by the solver in bytes
+/*!
+  Adds the CoolProp state objects, the smoothing tables and the share of
+  the tiled table and of the critical band (see TiledTable::memoryShare)
+  to the memory counted by the base class. The fluid data and the TTSE tables are owned by CoolProp and shared by
+  all the solvers of the same fluid, so they are not included.
+*/
+size_t CoolPropSolver::memoryUsage(){
+	size_t tables = 0;
+	{
+		ScopedLock lock(_smoothingMutex);
+		for (int i = 0; i < 2; i++)
+			tables += _smoothingTables[i].nodes.size()*(sizeof(SmoothingNode) + 4*sizeof(void *)) +
+				_smoothingTables[i].intervals.size()*(sizeof(char) + sizeof(long) + 4*sizeof(void *));
+		if (_splineState != NULL)
+			tables += sizeof(CoolPropStateClassSI);
+	}
+	if (_tiles != NULL)
+		tables += _tiles->memoryShare();
+	if (_criticalBand != NULL)
+		tables += _criticalBand->memoryShare();
+	return BaseSolver::memoryUsage() + sizeof(CoolPropSolver) - sizeof(BaseSolver) + tables +
+		(state != NULL ? sizeof(CoolPropStateClassSI) : 0);
+}
+
+//! Return the options of the solver that switch the shared fluid object
+/*!
+  A combination of TABLE_OPTION_xx: the look-up tables, their bicubic
+  interpolation and the extension of the two-phase region.
+*/
+int CoolPropSolver::tableOptions(){
+	return ((enable_TTSE || enable_BICUBIC) ? TABLE_OPTION_TABLES : 0) |
+		(enable_BICUBIC ? TABLE_OPTION_BICUBIC : 0) | (extend_twophase ? TABLE_OPTION_EXTTP : 0);
+}
+
+//! Apply the table options of the solver to the fluid object
+/*!
+  The tables, their interpolation mode and the extension of the two-phase
+  region are switched in the fluid object shared with the solvers of the
+  same fluid. The switches are written under the lock of the tables
+  record, and only if the options of the solver differ from those applied
+  last, so that the solvers with the same options never write to the
+  fluid object, see isReentrant. The tables stay disabled until they are
+  built (see buildTables), so nothing is called on them before, which
+  keeps the solvers off the fluid object while a background thread builds
+  them.
+*/
+void CoolPropSolver::setTableOptions(){
+	SharedTables *tables = _sharedTables;
+	bool ready = tables->ready.done() && _tablesOnce.done();
+	int options = tableOptions();
+	if (!ready || !(options & TABLE_OPTION_TABLES))
+		options &= ~(TABLE_OPTION_TABLES | TABLE_OPTION_BICUBIC);
+
+	char error[1000] = "";
+	{
+		ScopedLock lock(tables->mutex);
+		if (tables->options < 0)
+			tables->options = tableOptions();
+		if (options == tables->applied)
+			return;
+		try {
+			if (ready){
+				if (options & TABLE_OPTION_TABLES){
+					if (!state->isenabled_TTSE_LUT())
+						state->enable_TTSE_LUT();
+					state->pFluid->TTSESinglePhase.set_mode((options & TABLE_OPTION_BICUBIC) ? TTSE_MODE_BICUBIC : TTSE_MODE_TTSE);
+				}
+				else if (state->isenabled_TTSE_LUT())
+					state->disable_TTSE_LUT();
+			}
+			if (options & TABLE_OPTION_EXTTP)
 				state->enable_EXTTP();
 			else
 				state->disable_EXTTP();
+			tables->applied = options;
+		} catch(std::exception &e) {
+			// Reported once the lock is released, since the Modelica error function does not return
+			strncpy(error, e.what(), sizeof(error) - 2);
+			error[sizeof(error) - 2] = '\0';
 		}
-		catch(std::exception &e)
-		{
-			errorMessage((char*)e.what());
-			std::cout << format("Exception from state object: %s \n",(char*)e.what());
+	}
+	if (error[0] != '\0')
+		errorMessage(error);
+}
+
+//! Return the tiled (p,h) table of the solver, NULL if the option enable_tiles is not set
+TiledTable *CoolPropSolver::tiledTable(){
+	return _tiles;
+}
+
+//! Compute a node of the tiled (p,h) table
+/*!
+  The nodes are computed with all the properties, whatever the property
+  mask, and without warm start. Two-phase nodes and failed flashes are
+  not interpolated; single-phase nodes are split at the critical density
+  into a liquid-like and a vapour-like region, so that no cell is
+  interpolated across the saturation curve or the critical point.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param properties ExternalThermodynamicState property struct
+  @return 1 for liquid-like states, 2 for vapour-like states, 0 if not to be interpolated
+*/
+int CoolPropSolver::tableNode(double p, double h, ExternalThermodynamicState *const properties){
+	try{
+		state->update(iP,p,iH,h);
+		if (!ValidNumber(state->rho()) || !ValidNumber(state->T()) || state->TwoPhase)
+			return 0;
+		properties->p = p;
+		properties->T = state->T();
+		properties->d = state->rho();
+		properties->h = h;
+		properties->s = state->s();
+		properties->phase = 1;
+		properties->cp = state->cp();
+		properties->cv = state->cv();
+		properties->a  = state->speed_sound();
+		properties->ddhp = state->drhodh_constp();
+		properties->ddph = state->drhodp_consth();
+		properties->kappa = state->isothermal_compressibility();
+		properties->beta  = state->isobaric_expansion_coefficient();
+		properties->eta    = calc_transport ? state->viscosity() : NAN;
+		properties->lambda = calc_transport ? state->conductivity() : NAN;
+	}
+	catch(std::exception &)
+	{
+		return 0;
+	}
+	initFluidConstants();
+	return properties->d > _fluidConstants.dc ? 1 : 2;
+}
+
+//! Return the tables around the critical point, NULL if disabled
+/*!
+  The band is shared by the solvers with the same cache key and only
+  exists for fluids with a saturation curve. Threads racing on the first
+  call each take a reference to the band; only the first one is kept.
+*/
+CriticalBand *CoolPropSolver::criticalBand(){
+	if (!_criticalBandOnce.done()){
+		CriticalBand *band = NULL;
+		if ((fluidType==FLUID_TYPE_PURE)||(fluidType==FLUID_TYPE_PSEUDOPURE)||(fluidType==FLUID_TYPE_REFPROP)){
+			initFluidConstants();
+			band = CriticalBand::shared(_cacheKey, _fluidConstants.pc);
 		}
+		ScopedLock lock(_criticalBandMutex);
+		if (_criticalBandOnce.done())
+			CriticalBand::release(band);
+		else {
+			_criticalBand = band;
+			_criticalBandOnce.setDone();
+		}
+	}
+	return _criticalBand;
+}
+
+//! Compute the saturation properties of a node of the critical band
+/*!
+  Like setSat_p, but failures are returned instead of reported.
+  @param p Pressure
+  @param properties ExternalSaturationProperties property struct
+  @return False if the saturation properties could not be computed
+*/
+bool CoolPropSolver::bandSaturation(double p, ExternalSaturationProperties *const properties){
+	try{
+		state->update(iP,p,iQ,0); // quality only matters for pseudo-pure fluids
+		this->postSatChange(p, state->TL(), properties); // TL() not correct for pseudo-pure fluids
+	}
+	catch(std::exception &)
+	{
+		return false;
+	}
+	return ValidNumber(properties->Tsat) && ValidNumber(properties->dl) && ValidNumber(properties->dv) &&
+		ValidNumber(properties->hl) && ValidNumber(properties->hv) && ValidNumber(properties->dTp) &&
+		properties->dl > properties->dv;
+}
+
+void CoolPropSolver::preStateChange(void) {
+	/// Some common code to avoid pitfalls from incompressibles
+	if ((fluidType==FLUID_TYPE_PURE)||(fluidType==FLUID_TYPE_PSEUDOPURE)||(fluidType==FLUID_TYPE_REFPROP)){
+		if (!_tablesOnce.done())
+			initTables();
+		setTableOptions();
 	}
 }
 
 void CoolPropSolver::postStateChange(ExternalThermodynamicState *const properties) {
 	/// Some common code to avoid pitfalls from incompressibles
+	// Properties outside the mask are not computed, see setPropertyMask
+	int mask = this->propertyMask();
+	bool derivatives = (mask & (PROPERTY_ddhp | PROPERTY_ddph)) != 0;
 	switch (fluidType) {
 		case FLUID_TYPE_PURE:
 		case FLUID_TYPE_PSEUDOPURE:
@@ -214,38 +711,51 @@ void CoolPropSolver::postStateChange(ExternalThermodynamicState *const propertie
 				else{
 					properties->phase = 1;
 				}
-				properties->cp = state->cp();
-				properties->cv = state->cv();
-				properties->a = state->speed_sound();
-				if (state->TwoPhase && state->Q() >= 0 && state->Q() <= twophase_derivsmoothing_xend && twophase_derivsmoothing_xend > 0.0)
+				properties->cp = (mask & PROPERTY_cp) ? state->cp() : NAN;
+				properties->cv = (mask & PROPERTY_cv) ? state->cv() : NAN;
+				properties->a  = (mask & PROPERTY_a)  ? state->speed_sound() : NAN;
+				double rho_spline;
+				double dsplinedh;
+				double dsplinedp;
+				if (derivatives && state->TwoPhase && state->Q() >= 0 && state->Q() <= twophase_derivsmoothing_xend && twophase_derivsmoothing_xend > 0.0)
 				{
-					// Use the smoothed derivatives between a quality of 0 and twophase_derivsmoothing_xend
-					properties->ddhp = state->drhodh_constp_smoothed(twophase_derivsmoothing_xend); // [1/kPa -- > 1/Pa]
-					properties->ddph = state->drhodp_consth_smoothed(twophase_derivsmoothing_xend); // [1/(kJ/kg) -- > 1/(J/kg)]
+					// Use the smoothed derivatives between a quality of 0 and twophase_derivsmoothing_xend,
+					// from the pressure table if possible
+					if (smoothedProperties(SMOOTHING_DERIVATIVES, state->p(), state->Q(), rho_spline, dsplinedh, dsplinedp)){
+						properties->ddhp = dsplinedh;
+						properties->ddph = dsplinedp;
+					} else {
+						properties->ddhp = state->drhodh_constp_smoothed(twophase_derivsmoothing_xend); // [1/kPa -- > 1/Pa]
+						properties->ddph = state->drhodp_consth_smoothed(twophase_derivsmoothing_xend); // [1/(kJ/kg) -- > 1/(J/kg)]
+					}
 				}
 				else if (state->TwoPhase && state->Q() >= 0 && state->Q() <= rho_smoothing_xend && rho_smoothing_xend > 0.0)
 				{
-					// Use the smoothed density between a quality of 0 and rho_smoothing_xend
-					double rho_spline;
-					double dsplinedh;
-					double dsplinedp;
-					state->rho_smoothed(rho_smoothing_xend, rho_spline, dsplinedh, dsplinedp) ;
+					// Use the smoothed density between a quality of 0 and rho_smoothing_xend,
+					// from the pressure table if possible
+					if (!smoothedProperties(SMOOTHING_DENSITY, state->p(), state->Q(), rho_spline, dsplinedh, dsplinedp))
+						state->rho_smoothed(rho_smoothing_xend, rho_spline, dsplinedh, dsplinedp) ;
 					properties->ddhp = dsplinedh;
 					properties->ddph = dsplinedp;
 					properties->d = rho_spline;
 				}
-				else
+				else if (derivatives)
 				{
 					properties->ddhp = state->drhodh_constp();
 					properties->ddph = state->drhodp_consth();
 				}
-				properties->kappa = state->isothermal_compressibility();
-				properties->beta = state->isobaric_expansion_coefficient();
+				else
+				{
+					properties->ddhp = NAN;
+					properties->ddph = NAN;
+				}
+				properties->kappa = (mask & PROPERTY_kappa) ? state->isothermal_compressibility() : NAN;
+				properties->beta  = (mask & PROPERTY_beta)  ? state->isobaric_expansion_coefficient() : NAN;
 
 				if (calc_transport)
 				{
-					properties->eta = state->viscosity();
-					properties->lambda = state->conductivity(); //[kW/m/K --> W/m/K]
+					properties->eta    = (mask & PROPERTY_eta)    ? state->viscosity() : NAN;
+					properties->lambda = (mask & PROPERTY_lambda) ? state->conductivity() : NAN; //[kW/m/K --> W/m/K]
 				} else {
 					properties->eta    = NAN;
 					properties->lambda = NAN;
@@ -266,17 +776,17 @@ void CoolPropSolver::postStateChange(ExternalThermodynamicState *const propertie
 				properties->h = state->h();
 				properties->s = state->s();
 				properties->phase = 1;
-				properties->cp = state->cp();
-				properties->cv = state->cv();
+				properties->cp = (mask & PROPERTY_cp) ? state->cp() : NAN;
+				properties->cv = (mask & PROPERTY_cv) ? state->cv() : NAN;
 				properties->a     = NAN;
-				properties->ddhp = state->drhodh_constp();
+				properties->ddhp = (mask & PROPERTY_ddhp) ? state->drhodh_constp() : NAN;
 				properties->ddph = 0.0; // TODO: Fix this
 				properties->kappa = NAN;
 				properties->beta  = NAN;
 				if (calc_transport)
 				{
-					properties->eta = state->viscosity();
-					properties->lambda = state->conductivity(); //[kW/m/K --> W/m/K]
+					properties->eta    = (mask & PROPERTY_eta)    ? state->viscosity() : NAN;
+					properties->lambda = (mask & PROPERTY_lambda) ? state->conductivity() : NAN; //[kW/m/K --> W/m/K]
 				} else {
 					properties->eta    = NAN;
 					properties->lambda = NAN;
@@ -300,12 +810,82 @@ void CoolPropSolver::postStateChange(ExternalThermodynamicState *const propertie
 }
 
 
+//! Update the state object
+/*!
+  This function updates the internal state object for the given inputs.
+  A known phase (1 for one-phase, 2 for two-phase) is passed on to
+  CoolProp, which then skips the saturation check and goes directly to
+  the single-phase or two-phase solution. A two-phase hint is ignored
+  for pressures above the critical one. Iterative flashes are started
+  from the last nearby solution, if available, or from the previous
+  solution if it belongs to a neighbouring point; a warm started flash
+  that fails is repeated without initial guess.
+  @param inputChoice Input choice, see externalmedialib.h
+  @param iInput1 CoolProp key of the first input
+  @param input1 Value of the first input
+  @param iInput2 CoolProp key of the second input
+  @param input2 Value of the second input
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param neighbour True if the previous flash was computed for a neighbouring point
+*/
+void CoolPropSolver::updateState(int inputChoice, long iInput1, double input1, long iInput2, double input2, int phase, bool neighbour){
+	bool iterative = (inputChoice == CHOICE_ph || inputChoice == CHOICE_ps || inputChoice == CHOICE_hs);
+	if (phase == 2 && iInput1 == iP){
+		initFluidConstants();
+		if (input1 >= _fluidConstants.pc)
+			phase = 0;
+	}
+
+	double T0 = -1, rho0 = -1;
+	bool warm = iterative && flashGuess(inputChoice, input1, input2, neighbour, T0, rho0);
+	if (enable_TTSE || enable_BICUBIC)
+		countEvaluation(_tablesOnce.done());
+
+	state->flag_SinglePhase = (phase == 1);
+	state->flag_TwoPhase    = (phase == 2);
+	try{
+		bool converged = true;
+		try{
+			state->update(iInput1,input1,iInput2,input2,T0,rho0);
+			converged = ValidNumber(state->T()) && ValidNumber(state->rho());
+		}
+		catch(std::exception &)
+		{
+			if (!warm)
+				throw;
+			converged = false;
+		}
+		if (warm && !converged)
+			state->update(iInput1,input1,iInput2,input2,-1,-1);
+	}
+	catch(std::exception &)
+	{
+		state->flag_SinglePhase = false;
+		state->flag_TwoPhase    = false;
+		throw;
+	}
+	state->flag_SinglePhase = false;
+	state->flag_TwoPhase    = false;
+
+	if (iterative && ValidNumber(state->T()) && ValidNumber(state->rho()))
+		storeFlashSolution(inputChoice, input1, input2, state->T(), state->rho());
+}
+
 void CoolPropSolver::setSat_p(double &p, ExternalSaturationProperties *const properties){
 
 	if (debug_level > 5)
 		std::cout << format("setSat_p(%0.16e)\n",p);
 
-	if (p > _satPropsClose2Crit.psat) { // supercritical conditions
+	// Pressures close to the critical one are interpolated in the critical band if enabled
+	CriticalBand *band = criticalBand();
+	if (band != NULL){
+		this->preStateChange();
+		if (band->setSat_p(p, *this, properties))
+			return;
+	}
+
+	if (p > psatClose2Crit()) { // supercritical conditions
+		initSatPropsClose2Crit();
 		properties->Tsat  = _satPropsClose2Crit.Tsat;  // saturation temperature
 		properties->dTp   = _satPropsClose2Crit.dTp;   // derivative of Ts by pressure
 		properties->ddldp = _satPropsClose2Crit.ddldp; // derivative of dls by pressure
@@ -322,40 +902,24 @@ void CoolPropSolver::setSat_p(double &p, ExternalSaturationProperties *const pro
 		properties->sv    = _satPropsClose2Crit.sv;    // Specific entropy at dew line (for pressure ps)
 	} else {
 	  this->preStateChange();
-	  try {
+	  setSat_p_direct(p, properties);
+    }
+}
+
+//! Compute the saturation properties at a subcritical pressure with CoolProp
+/*!
+  Neither the critical band nor the near-critical record are used.
+  preStateChange must have been called.
+  @param p Pressure
+  @param properties ExternalSaturationProperties property struct
+*/
+void CoolPropSolver::setSat_p_direct(double p, ExternalSaturationProperties *const properties){
+	try {
 		state->update(iP,p,iQ,0); // quality only matters for pseudo-pure fluids
-		//! Saturation temperature
-		properties->Tsat = state->TL(); // Not correct for pseudo-pure fluids
-		//! Derivative of Ts wrt pressure
-		properties->dTp = state->dTdp_along_sat();
-		//! Derivative of dls wrt pressure
-		properties->ddldp = state->drhodp_along_sat_liquid();
-		//! Derivative of dvs wrt pressure
-		properties->ddvdp = state->drhodp_along_sat_vapor();
-		//! Derivative of hls wrt pressure
-		properties->dhldp = state->dhdp_along_sat_liquid();
-		//! Derivative of hvs wrt pressure
-		properties->dhvdp = state->dhdp_along_sat_vapor();
-		//! Density at bubble line (for pressure ps)
-		properties->dl = state->rhoL();
-		//! Density at dew line (for pressure ps)
-		properties->dv = state->rhoV();
-		//! Specific enthalpy at bubble line (for pressure ps)
-		properties->hl = state->hL();
-		//! Specific enthalpy at dew line (for pressure ps)
-		properties->hv = state->hV();
-		//! Saturation pressure
-		properties->psat = p;
-		//! Surface tension
-		properties->sigma = state->surface_tension();
-		//! Specific entropy at bubble line (for pressure ps)
-		properties->sl = state->sL();
-		//! Specific entropy at dew line (for pressure ps)
-		properties->sv = state->sV();
-	  } catch(std::exception &e) {
+		this->postSatChange(p, state->TL(), properties); // TL() not correct for pseudo-pure fluids
+	} catch(std::exception &e) {
 		errorMessage((char*)e.what());
-	  }
-    }
+	}
 }
 
 void CoolPropSolver::setSat_T(double &T, ExternalSaturationProperties *const properties){
@@ -363,6 +927,15 @@ void CoolPropSolver::setSat_T(double &T, ExternalSaturationProperties *const pro
 	if (debug_level > 5)
 		std::cout << format("setSat_T(%0.16e)\n",T);
 
+	// Temperatures close to the critical one are interpolated in the critical band if enabled
+	CriticalBand *band = criticalBand();
+	if (band != NULL){
+		this->preStateChange();
+		if (band->setSat_T(T, *this, properties))
+			return;
+	}
+
+	initSatPropsClose2Crit();
 	if (T > _satPropsClose2Crit.Tsat) { // supercritical conditions
 		properties->Tsat  = _satPropsClose2Crit.Tsat;  // saturation temperature
 		properties->dTp   = _satPropsClose2Crit.dTp;   // derivative of Ts by pressure
@@ -383,58 +956,385 @@ void CoolPropSolver::setSat_T(double &T, ExternalSaturationProperties *const pro
 	  try
 	  {
 		state->update(iT,T,iQ,0); // Quality only matters for pseudo-pure fluids
+		this->postSatChange(state->pL(), T, properties);
+	  } catch(std::exception &e) {
+		errorMessage((char*)e.what());
+	  }
+	}
+}
 
-		properties->Tsat = T;
-		properties->psat = state->pL();
-		properties->dl = state->rhoL();
-		properties->dv = state->rhoV();
-		properties->hl = state->hL();
-		properties->hv = state->hV();
-		properties->dTp = state->dTdp_along_sat();
+//! Set the saturation properties from the saturated state object
+/*!
+  This function fills the saturation properties record from the internal
+  state object, which must hold a saturated or two-phase state.
+  @param psat Saturation pressure
+  @param Tsat Saturation temperature
+  @param properties ExternalSaturationProperties property struct
+*/
+void CoolPropSolver::postSatChange(double psat, double Tsat, ExternalSaturationProperties *const properties){
+	//! Saturation temperature
+	properties->Tsat = Tsat;
+	//! Saturation pressure
+	properties->psat = psat;
+	//! Derivative of Ts wrt pressure
+	properties->dTp = state->dTdp_along_sat();
+	//! Derivative of dls wrt pressure
+	properties->ddldp = state->drhodp_along_sat_liquid();
+	//! Derivative of dvs wrt pressure
+	properties->ddvdp = state->drhodp_along_sat_vapor();
+	//! Derivative of hls wrt pressure
+	properties->dhldp = state->dhdp_along_sat_liquid();
+	//! Derivative of hvs wrt pressure
+	properties->dhvdp = state->dhdp_along_sat_vapor();
+	//! Density at bubble line (for pressure ps)
+	properties->dl = state->rhoL();
+	//! Density at dew line (for pressure ps)
+	properties->dv = state->rhoV();
+	//! Specific enthalpy at bubble line (for pressure ps)
+	properties->hl = state->hL();
+	//! Specific enthalpy at dew line (for pressure ps)
+	properties->hv = state->hV();
+	//! Surface tension
+	properties->sigma = state->surface_tension();
+	//! Specific entropy at bubble line (for pressure ps)
+	properties->sl = state->sL();
+	//! Specific entropy at dew line (for pressure ps)
+	properties->sv = state->sV();
+}
 
-		properties->ddldp = state->drhodp_along_sat_liquid();
-		properties->ddvdp = state->drhodp_along_sat_vapor();
-		properties->dhldp = state->dhdp_along_sat_liquid();
-		properties->dhvdp = state->dhdp_along_sat_vapor();
+//! Compute saturation properties for a newly computed state
+/*!
+  If the state just computed is two-phase, the internal state object
+  already holds the saturation data at its pressure, which is used
+  directly instead of a new saturation computation.
+  @param properties ExternalThermodynamicState property struct of the new state
+  @param satProperties ExternalSaturationProperties property struct
+*/
+void CoolPropSolver::setSat_p_newState(ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties){
+	// States computed without the state object, see setState_ph_twoPhase, leave their record in the cache
+	if (findSaturationProperties(true, properties->p, satProperties))
+		return;
+	bool pure = (fluidType == FLUID_TYPE_PURE || fluidType == FLUID_TYPE_REFPROP);
+	if (pure && state->TwoPhase && properties->phase == 2 && properties->p <= psatClose2Crit()) {
+		try {
+			this->postSatChange(properties->p, properties->T, satProperties);
+		} catch(std::exception &e) {
+			errorMessage((char*)e.what());
+		}
+	} else {
+		setSat_p(properties->p, satProperties);
+	}
+}
 
-		properties->sigma = state->surface_tension(); // Surface tension
-		properties->sl    = state->sL();    // Specific entropy at bubble line (for pressure ps)
-		properties->sv    = state->sV();    // Specific entropy at dew line (for pressure ps)
+/// Set bubble state, assembled from the saturated liquid state
+void CoolPropSolver::setBubbleState(ExternalSaturationProperties *const properties, int phase, ExternalThermodynamicState *const bubbleProperties){
+	setSaturationBoundaryState(properties, true, phase, bubbleProperties);
+}
 
+/// Set dew state, assembled from the saturated vapour state
+void CoolPropSolver::setDewState(ExternalSaturationProperties *const properties, int phase, ExternalThermodynamicState *const dewProperties){
+	setSaturationBoundaryState(properties, false, phase, dewProperties);
+}
 
-	  } catch(std::exception &e) {
-		errorMessage((char*)e.what());
-	  }
+//! Return true if two-phase p-h states at the given pressure can be computed by the lever rule
+/*!
+  Applies to pure fluids below the near-critical region, when the property
+  mask does not request any of cp, cv, a, kappa, beta and the transport
+  properties, which would need a state update anyway.
+  @param p Pressure
+*/
+bool CoolPropSolver::leverRule(double p){
+	bool pure = (fluidType == FLUID_TYPE_PURE || fluidType == FLUID_TYPE_REFPROP);
+	int stateProperties = PROPERTY_cp | PROPERTY_cv | PROPERTY_a | PROPERTY_kappa | PROPERTY_beta |
+		(calc_transport ? PROPERTY_eta | PROPERTY_lambda : 0);
+	return pure && !(this->propertyMask() & stateProperties) && p < psatClose2Crit();
+}
+
+//! Compute a two-phase state from p and h by the lever rule
+/*!
+  T, d, s and the density derivatives of a two-phase state follow from the
+  saturation properties at p and the quality computed from h, without a
+  flash. The saturation record must be in the cache of the solver, where
+  the setState_xx_sat and setSat functions and the two-phase flashes (see
+  storeFlashSaturation) leave it: computing it here would cost as much as
+  the flash. States at the same pressure, e.g. the control volumes of a
+  heat exchanger with a lumped pressure or the columns of a Jacobian in h,
+  then only cost a few operations. In the quality band of the smoothing
+  options the density and its derivatives are taken from the pressure
+  tables, see smoothedProperties.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param phase Phase hint, set to 1 or 2 if the phase is found but the state is left to the flash
+  @param properties ExternalThermodynamicState property struct
+  @return True if the state was computed
+*/
+bool CoolPropSolver::setState_ph_twoPhase(double p, double h, int &phase, ExternalThermodynamicState *const properties){
+	ExternalSaturationProperties sat;
+	if (phase == 1 || !leverRule(p) || !findSaturationProperties(true, p, &sat))
+		return false;
+	if (h < sat.hl || h > sat.hv){
+		phase = 1;
+		return false;
+	}
+	double x = (h - sat.hl)/(sat.hv - sat.hl);
+
+	// Smoothed density and derivatives in the quality band of the smoothing options, as in postStateChange
+	int mask = this->propertyMask();
+	bool derivatives = (mask & (PROPERTY_ddhp | PROPERTY_ddph)) != 0;
+	bool derivSmoothing = derivatives && twophase_derivsmoothing_xend > 0.0 && x <= twophase_derivsmoothing_xend;
+	bool rhoSmoothing = !derivSmoothing && rho_smoothing_xend > 0.0 && x <= rho_smoothing_xend;
+	double d_spline, ddhp_spline, ddph_spline;
+	if ((derivSmoothing && !smoothedProperties(SMOOTHING_DERIVATIVES, p, x, d_spline, ddhp_spline, ddph_spline)) ||
+		(rhoSmoothing && !smoothedProperties(SMOOTHING_DENSITY, p, x, d_spline, ddhp_spline, ddph_spline))){
+		phase = 2;
+		return false;
 	}
+
+	double vl = 1/sat.dl;
+	double vv = 1/sat.dv;
+	double v = vl + x*(vv - vl);
+	properties->p = p;
+	properties->T = sat.Tsat;
+	properties->d = 1/v;
+	properties->h = h;
+	properties->s = sat.sl + x*(sat.sv - sat.sl);
+	properties->phase = 2;
+	// Derivatives of the specific volume v = vl + x*(vv - vl), x = (h - hl)/(hv - hl)
+	if (mask & PROPERTY_ddhp)
+		properties->ddhp = -(vv - vl)/(sat.hv - sat.hl)/(v*v);
+	else
+		properties->ddhp = NAN;
+	if (mask & PROPERTY_ddph){
+		double dvldp = -sat.ddldp*vl*vl;
+		double dvvdp = -sat.ddvdp*vv*vv;
+		double dxdp  = -(sat.dhldp + x*(sat.dhvdp - sat.dhldp))/(sat.hv - sat.hl);
+		properties->ddph = -(dvldp + x*(dvvdp - dvldp) + (vv - vl)*dxdp)/(v*v);
+	}
+	else
+		properties->ddph = NAN;
+	if (derivSmoothing || rhoSmoothing){
+		properties->ddhp = ddhp_spline;
+		properties->ddph = ddph_spline;
+	}
+	if (rhoSmoothing)
+		properties->d = d_spline;
+
+	// Not requested, see leverRule
+	properties->cp = properties->cv = properties->a = NAN;
+	properties->kappa = properties->beta = NAN;
+	properties->eta = properties->lambda = NAN;
+	return true;
 }
 
-/// Set bubble state
-void CoolPropSolver::setBubbleState(ExternalSaturationProperties *const properties, int phase, ExternalThermodynamicState *const bubbleProperties){
-	double hl;
-	if (phase == 0)
-		hl = properties->hl;
-	else if (phase == 1) // liquid phase
-		hl = properties->hl-_delta_h;
-	else                 // two-phase mixture
-		hl = properties->hl+_delta_h;
+//! Store the saturation record of a two-phase flash for the lever rule
+/*!
+  Called after a p-h flash. The state object of a two-phase state holds
+  the saturated states at its pressure, so the record is assembled from
+  them without another saturation computation and stored in the cache, for
+  the following states at the same pressure, see setState_ph_twoPhase, and
+  for setSat_p_state. The record is stored whatever the property mask, which
+  only decides whether the lever rule may use it.
+  @param p Pressure
+*/
+void CoolPropSolver::storeFlashSaturation(double p){
+	bool pure = (fluidType == FLUID_TYPE_PURE || fluidType == FLUID_TYPE_REFPROP);
+	if (!pure || !state->TwoPhase || !(p < psatClose2Crit()))
+		return;
+	ExternalSaturationProperties sat;
+	if (findSaturationProperties(true, p, &sat))
+		return;
+	try{
+		this->postSatChange(p, state->T(), &sat);
+	}
+	catch(std::exception &)
+	{
+		return;
+	}
+	storeSaturationProperties(true, p, sat);
+}
 
-	setState_ph(properties->psat, hl, phase, bubbleProperties);
+//! Grid spacing of the smoothing tables in ln(p)
+static const double smoothingDlogp = 0.01;
+//! Relative tolerance of the check of the smoothing tables against CoolProp
+static const double smoothingTolerance = 1e-6;
+
+//! Interpolate the smoothed two-phase properties in an interval of a smoothing table
+/*!
+  The nodes k - 1 to k + 2 must be in the table, and the lock of the
+  tables held.
+  @param t Position in the interval, between 0 and 1
+  @param x Quality
+  @param values Density, ddhp and ddph
+*/
+void CoolPropSolver::interpolateSmoothing(SmoothingTable &table, long k, double t, double x, double *values){
+	// Lagrange weights of the nodes k - 1 to k + 2
+	double w[4] = {-t*(t - 1)*(t - 2)/6, (t + 1)*(t - 1)*(t - 2)/2, -(t + 1)*t*(t - 2)/2, (t + 1)*t*(t - 1)/6};
+	for (int m = 0; m < 3; m++)
+		values[m] = 0;
+	for (int j = 0; j < 4; j++){
+		const SmoothingNode &node = table.nodes[k - 1 + j];
+		for (int m = 0; m < 3; m++){
+			const double *c = node.c[m];
+			values[m] += w[j]*(((c[0]*x + c[1])*x + c[2])*x + c[3]);
+		}
+	}
 }
 
-/// Set dew state
-void CoolPropSolver::setDewState(ExternalSaturationProperties *const properties, int phase, ExternalThermodynamicState *const dewProperties){
-	double hv;
-	if (phase == 0)
-		hv = properties->hv;
-	else if (phase == 1) // gaseous phase
-		hv = properties->hv+_delta_h;
-	else                 // two-phase mixture
-		hv = properties->hv-_delta_h;
+//! Compute the smoothed two-phase properties with CoolProp
+/*!
+  The properties are those of postStateChange without tables: for the
+  option twophase_derivsmoothing_xend, drhodh_constp_smoothed and
+  drhodp_consth_smoothed, with the unsmoothed density; for the option
+  rho_smoothing_xend, rho_smoothed. Uses a separate state object, so that
+  the state object of the solver is left unchanged; it is created on first
+  need and used under the lock of the smoothing tables.
+  @param option SMOOTHING_DERIVATIVES or SMOOTHING_DENSITY
+  @param p Pressure
+  @param x Quality
+  @param values Density, ddhp and ddph
+  @return False if CoolProp failed
+*/
+bool CoolPropSolver::smoothingSample(int option, double p, double x, double *values){
+	ScopedLock lock(_smoothingMutex);
+	try{
+		if (_splineState == NULL)
+			_splineState = new CoolPropStateClassSI(substanceName);
+		_splineState->update(iP,p,iQ,x);
+		if (option == SMOOTHING_DERIVATIVES){
+			values[0] = _splineState->rho();
+			values[1] = _splineState->drhodh_constp_smoothed(twophase_derivsmoothing_xend);
+			values[2] = _splineState->drhodp_consth_smoothed(twophase_derivsmoothing_xend);
+		}
+		else
+			_splineState->rho_smoothed(rho_smoothing_xend, values[0], values[1], values[2]);
+	}
+	catch(std::exception &)
+	{
+		return false;
+	}
+	return ValidNumber(values[0]) && ValidNumber(values[1]) && ValidNumber(values[2]);
+}
+
+//! Make sure an interval of a smoothing table has been computed and checked
+/*!
+  At fixed pressure, CoolProp's smoothing splines and their derivatives
+  are polynomials of degree 3 at most in h, hence in the quality. Each
+  node of the grid in ln(p) stores these polynomials, fitted through four
+  qualities in the smoothing band, so that it reproduces CoolProp's
+  formulas at its pressure. Between the nodes k and k + 1 the polynomials
+  are interpolated by a cubic in ln(p) through the nodes k - 1 to k + 2,
+  and the interval is only used if the interpolation matches CoolProp at
+  its middle within smoothingTolerance, at three qualities. This also
+  checks the degree of the polynomials.
+
+  The lock is only held by the CoolProp evaluations (see smoothingSample)
+  and while the tables are read or written; threads racing on the same
+  interval compute the same values.
+  @param option SMOOTHING_DERIVATIVES or SMOOTHING_DENSITY
+  @param k Index of the interval
+  @return True if the interval can be interpolated
+*/
+bool CoolPropSolver::smoothingInterval(int option, long k){
+	SmoothingTable &table = _smoothingTables[option];
+	double xend = option == SMOOTHING_DERIVATIVES ? twophase_derivsmoothing_xend : rho_smoothing_xend;
+	{
+		ScopedLock lock(_smoothingMutex);
+		map<long, char>::const_iterator it = table.intervals.find(k);
+		if (it != table.intervals.end())
+			return it->second != 0;
+	}
+
+	bool ok = true;
+	for (long j = k - 1; j <= k + 2 && ok; j++){
+		{
+			ScopedLock lock(_smoothingMutex);
+			map<long, SmoothingNode>::const_iterator it = table.nodes.find(j);
+			if (it != table.nodes.end()){
+				ok = it->second.valid;
+				continue;
+			}
+		}
+		SmoothingNode node;
+		double x[4], values[4][3];
+		node.valid = true;
+		for (int i = 0; i < 4 && node.valid; i++){
+			x[i] = xend*(i + 0.5)/4;
+			node.valid = smoothingSample(option, exp(j*smoothingDlogp), x[i], values[i]);
+		}
+		// Newton divided differences, then the monomial coefficients
+		for (int m = 0; m < 3 && node.valid; m++){
+			double a[4];
+			for (int i = 0; i < 4; i++)
+				a[i] = values[i][m];
+			for (int level = 1; level < 4; level++)
+				for (int i = 3; i >= level; i--)
+					a[i] = (a[i] - a[i - 1])/(x[i] - x[i - level]);
+			double *c = node.c[m];
+			c[0] = a[3];
+			c[1] = a[2] - a[3]*(x[0] + x[1] + x[2]);
+			c[2] = a[1] - a[2]*(x[0] + x[1]) + a[3]*(x[0]*x[1] + x[0]*x[2] + x[1]*x[2]);
+			c[3] = a[0] - a[1]*x[0] + a[2]*x[0]*x[1] - a[3]*x[0]*x[1]*x[2];
+		}
+		ScopedLock lock(_smoothingMutex);
+		table.nodes[j] = node;
+		ok = node.valid;
+	}
+
+	// Check at the middle of the interval
+	for (int i = 0; i < 3 && ok; i++){
+		double p = exp((k + 0.5)*smoothingDlogp);
+		double x = xend*(2*i + 1)/6, exact[3], interpolated[3];
+		ok = smoothingSample(option, p, x, exact);
+		if (ok){
+			{
+				ScopedLock lock(_smoothingMutex);
+				interpolateSmoothing(table, k, 0.5, x, interpolated);
+			}
+			for (int m = 0; m < 3 && ok; m++)
+				ok = fabs(interpolated[m] - exact[m]) <= smoothingTolerance*fabs(exact[m]);
+		}
+	}
+	ScopedLock lock(_smoothingMutex);
+	table.intervals[k] = ok;
+	return ok;
+}
 
-	setState_ph(properties->psat, hv, phase, dewProperties);
+//! Compute the smoothed two-phase properties from the smoothing table of an option
+/*!
+  The smoothing options of CoolProp rebuild the end conditions of their
+  spline from saturation and two-phase state evaluations on every call.
+  The tables give the same values (see smoothingInterval) for the cost of
+  a few polynomial evaluations, at any pressure below the near-critical
+  region where the interpolation is accurate enough; elsewhere false is
+  returned and the caller calls CoolProp directly.
+  @param option SMOOTHING_DERIVATIVES or SMOOTHING_DENSITY
+  @param p Pressure
+  @param x Quality, within the band of the option
+  @param d Smoothed density, unsmoothed for SMOOTHING_DERIVATIVES
+  @param ddhp Derivative of the smoothed density by h at constant p
+  @param ddph Derivative of the smoothed density by p at constant h
+  @return False if the state must be computed by CoolProp
+*/
+bool CoolPropSolver::smoothedProperties(int option, double p, double x, double &d, double &ddhp, double &ddph){
+	if (!(p > 0) || !(p < psatClose2Crit()))
+		return false;
+	double t = log(p)/smoothingDlogp;
+	long k = (long)floor(t);
+	t -= k;
+	if (!smoothingInterval(option, k))
+		return false;
+
+	double values[3];
+	{
+		ScopedLock lock(_smoothingMutex);
+		interpolateSmoothing(_smoothingTables[option], k, t, x, values);
+	}
+	d = values[0];
+	ddhp = values[1];
+	ddph = values[2];
+	return true;
 }
 
-// Note: the phase input is currently not supported
 void CoolPropSolver::setState_ph(double &p, double &h, int &phase, ExternalThermodynamicState *const properties){
 
 	if (debug_level > 5)
@@ -442,9 +1342,22 @@ void CoolPropSolver::setState_ph(double &p, double &h, int &phase, ExternalTherm
 
 	this->preStateChange();
 
+	// Single-phase states are interpolated from the critical band or the tiled table if enabled
+	CriticalBand *band = criticalBand();
+	if (phase != 2 && ((band != NULL && band->setState_ph(p, h, *this, properties)) ||
+		(_tiles != NULL && _tiles->lookup(p, h, *this, properties)))){
+		applyPropertyMask(propertyMask(), properties);
+		return;
+	}
+
+	// Two-phase states are computed without a flash if possible
+	int flashPhase = phase;
+	if (setState_ph_twoPhase(p, h, flashPhase, properties))
+		return;
+
 	try{
 		// Update the internal variables in the state instance
-		state->update(iP,p,iH,h);
+		this->updateState(CHOICE_ph,iP,p,iH,h,flashPhase);
 
 		if (!ValidNumber(state->rho()) || !ValidNumber(state->T()))
 		{
@@ -453,6 +1366,7 @@ void CoolPropSolver::setState_ph(double &p, double &h, int &phase, ExternalTherm
 
 		// Set the values in the output structure
 		this->postStateChange(properties);
+		this->storeFlashSaturation(p);
 	}
 	catch(std::exception &e)
 	{
@@ -480,7 +1394,6 @@ void CoolPropSolver::setState_pT(double &p, double &T, ExternalThermodynamicStat
 	}
 }
 
-// Note: the phase input is currently not supported
 void CoolPropSolver::setState_dT(double &d, double &T, int &phase, ExternalThermodynamicState *const properties)
 {
 
@@ -492,7 +1405,7 @@ void CoolPropSolver::setState_dT(double &d, double &T, int &phase, ExternalTherm
 	try{
 
 		// Update the internal variables in the state instance
-		state->update(iD,d,iT,T);
+		this->updateState(CHOICE_dT,iD,d,iT,T,phase);
 
 		// Set the values in the output structure
 		this->postStateChange(properties);
@@ -503,7 +1416,6 @@ void CoolPropSolver::setState_dT(double &d, double &T, int &phase, ExternalTherm
 	}
 }
 
-// Note: the phase input is currently not supported
 void CoolPropSolver::setState_ps(double &p, double &s, int &phase, ExternalThermodynamicState *const properties){
 
 	if (debug_level > 5)
@@ -513,7 +1425,7 @@ void CoolPropSolver::setState_ps(double &p, double &s, int &phase, ExternalTherm
 
 	try{
 		// Update the internal variables in the state instance
-		state->update(iP,p,iS,s);
+		this->updateState(CHOICE_ps,iP,p,iS,s,phase);
 
 		// Set the values in the output structure
 		this->postStateChange(properties);
@@ -525,7 +1437,6 @@ void CoolPropSolver::setState_ps(double &p, double &s, int &phase, ExternalTherm
 }
 
 
-// Note: the phase input is currently not supported
 void CoolPropSolver::setState_hs(double &h, double &s, int &phase, ExternalThermodynamicState *const properties){
 
 	if (debug_level > 5)
@@ -535,7 +1446,7 @@ void CoolPropSolver::setState_hs(double &h, double &s, int &phase, ExternalTherm
 
 	try{
 		// Update the internal variables in the state instance
-		state->update(iH,h,iS,s);
+		this->updateState(CHOICE_hs,iH,h,iS,s,phase);
 
 		// Set the values in the output structure
 		this->postStateChange(properties);
@@ -546,12 +1457,130 @@ void CoolPropSolver::setState_hs(double &h, double &s, int &phase, ExternalTherm
 	}
 }
 
+//! Compute properties for an array of inputs
+/*!
+  The options of the state object are set once for the whole batch, then
+  the state object is updated for each element. For ordered batches each
+  flash is started from the solution of the previous element. A failed
+  flash does not skip the following elements: the first error is reported
+  once the batch is done, since errorMessage does not return.
+*/
+void CoolPropSolver::setStates(int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+							   bool ordered, ExternalThermodynamicState *const properties){
+
+	if (debug_level > 5)
+		std::cout << format("setStates(choice=%d,n=%d)\n",inputChoice,n);
+
+	long iInput1, iInput2;
+	switch(inputChoice){
+	case CHOICE_ph: iInput1 = iP; iInput2 = iH; break;
+	case CHOICE_pT: iInput1 = iP; iInput2 = iT; break;
+	case CHOICE_dT: iInput1 = iD; iInput2 = iT; break;
+	case CHOICE_ps: iInput1 = iP; iInput2 = iS; break;
+	case CHOICE_hs: iInput1 = iH; iInput2 = iS; break;
+	default:
+		errorMessage((char*)"Internal error: invalid input choice in setStates()");
+		return;
+	}
+
+	this->preStateChange();
+
+	bool tiles = (_tiles != NULL && inputChoice == CHOICE_ph);
+	CriticalBand *band = inputChoice == CHOICE_ph ? criticalBand() : NULL;
+	std::string error;
+	for (int i = 0; i < n; i++){
+		if ((!phase || phase[i] != 2) &&
+			((band != NULL && band->setState_ph(input1[i], input2[i], *this, properties + i)) ||
+			(tiles && _tiles->lookup(input1[i], input2[i], *this, properties + i)))){
+			applyPropertyMask(propertyMask(), properties + i);
+			continue;
+		}
+		int flashPhase = phase ? phase[i] : 0;
+		if (inputChoice == CHOICE_ph && setState_ph_twoPhase(input1[i], input2[i], flashPhase, properties + i))
+			continue;
+		try{
+			// Update the internal variables in the state instance
+			if (inputChoice == CHOICE_pT)
+				state->update(iInput1,input1[i],iInput2,input2[i]);
+			else
+				this->updateState(inputChoice,iInput1,input1[i],iInput2,input2[i],flashPhase,ordered && i > 0);
+
+			if (!ValidNumber(state->rho()) || !ValidNumber(state->T()))
+			{
+				throw ValueError(format("[%g, %g] failed for update in element %d",input1[i],input2[i],i));
+			}
+
+			// Set the values in the output structure
+			this->postStateChange(properties + i);
+			if (inputChoice == CHOICE_ph)
+				this->storeFlashSaturation(input1[i]);
+		}
+		catch(std::exception &e)
+		{
+			if (error.empty())
+				error = e.what();
+		}
+	}
+	if (!error.empty())
+		errorMessage((char*)error.c_str());
+}
+
+//! Compute saturation properties for an array of inputs
+/*!
+  The options of the state object are set once for the whole batch.
+  Supercritical inputs get the saturation properties close to the
+  critical point, as in setSat_p and setSat_T. As in setStates, the first
+  error is reported once the batch is done.
+*/
+void CoolPropSolver::setSats(bool byPressure, int n, const double *input, ExternalSaturationProperties *const properties){
+
+	if (debug_level > 5)
+		std::cout << format("setSats(byPressure=%d,n=%d)\n",byPressure,n);
+
+	double psatLimit = psatClose2Crit();
+	if (!byPressure)
+		initSatPropsClose2Crit();
+	this->preStateChange();
+
+	CriticalBand *band = criticalBand();
+	std::string error;
+	for (int i = 0; i < n; i++){
+		// Inputs close to the critical point are interpolated in the critical band if enabled
+		if (band != NULL && (byPressure ? band->setSat_p(input[i], *this, properties + i) :
+			band->setSat_T(input[i], *this, properties + i)))
+			continue;
+		if (byPressure ? input[i] > psatLimit : input[i] > _satPropsClose2Crit.Tsat) { // supercritical conditions
+			initSatPropsClose2Crit();
+			properties[i] = _satPropsClose2Crit;
+			continue;
+		}
+		try {
+			if (byPressure){
+				state->update(iP,input[i],iQ,0); // quality only matters for pseudo-pure fluids
+				this->postSatChange(input[i], state->TL(), properties + i); // TL() not correct for pseudo-pure fluids
+			} else {
+				state->update(iT,input[i],iQ,0); // Quality only matters for pseudo-pure fluids
+				this->postSatChange(state->pL(), input[i], properties + i);
+			}
+		} catch(std::exception &e) {
+			if (error.empty())
+				error = format("%s in element %d",e.what(),i);
+		}
+	}
+	if (!error.empty())
+		errorMessage((char*)error.c_str());
+}
+
 double CoolPropSolver::partialDeriv_state(const string &of, const string &wrt, const string &cst, ExternalThermodynamicState *const properties){
 	if (debug_level > 5)
 		std::cout << format("partialDeriv_state(of=%s,wrt=%s,cst=%s,state)\n",of.c_str(),wrt.c_str(),cst.c_str());
 
-	long derivTerm = makeDerivString(of,wrt,cst);
+	// One-phase states are handled by the derivative engine without a new update
 	double res = NAN;
+	if (partialDeriv_fromState(partialDeriv_id(of,wrt,cst), properties, res))
+		return res;
+
+	long derivTerm = makeDerivString(of,wrt,cst);
 
 	try{
 		//res = DerivTerms(derivTerm, properties->d, properties->T, this->substanceName);
@@ -564,6 +1593,79 @@ double CoolPropSolver::partialDeriv_state(const string &of, const string &wrt, c
 	return res;
 }
 
+//! Compute the derivatives of the properties of a one-phase state wrt T and d
+/*!
+  The derivatives of cv, kappa, beta, cp, a, ddhp and ddph follow from the
+  second derivatives of p and s in T and d given by the state object, with
+  p_T = beta/kappa, p_d = 1/(d kappa) and the Maxwell relation
+  s_d = -p_T/d^2:
+
+    cv = T s_T, kappa = 1/(d p_d), beta = p_T kappa,
+    cp = cv + T p_T^2/(d^2 p_d), a^2 = p_d + T p_T^2/(d^2 cv),
+    ddhp = -p_T/D, ddph = h_T/D with D = h_T p_d - h_d p_T,
+    h_T = cv + p_T/d, h_d = p_d/d - T p_T/d^2
+
+  The state object is only updated if it does not hold the state yet, so
+  after a flash no property is computed again. Two-phase states and the
+  transport properties are left to setState_jac.
+  @param properties ExternalThermodynamicState property struct of the state
+  @param derivativesT ExternalThermodynamicState property struct where to write the derivatives wrt T
+  @param derivativesD ExternalThermodynamicState property struct where to write the derivatives wrt d
+*/
+void CoolPropSolver::propertyDerivatives_dT(ExternalThermodynamicState *const properties, ExternalThermodynamicState *const derivativesT,
+											ExternalThermodynamicState *const derivativesD){
+	bool pure = (fluidType == FLUID_TYPE_PURE || fluidType == FLUID_TYPE_PSEUDOPURE || fluidType == FLUID_TYPE_REFPROP);
+	const double T = properties->T, d = properties->d;
+	const double cv = properties->cv, kappa = properties->kappa, beta = properties->beta;
+	if (!pure || properties->phase != 1 || ISNAN(cv) || ISNAN(kappa) || ISNAN(beta) ||
+		!(cv > 0) || !(kappa > 0) || !(d > 0) || !(T > 0))
+		return;
+
+	double pTT, pTd, pdd, sTT, sTd;
+	try{
+		if (state->T() != T || state->rho() != d)
+			state->update(iT,T,iD,d);
+		pTT = state->d2pdT2_constrho();
+		pTd = state->d2pdrhodT();
+		pdd = state->d2pdrho2_constT();
+		sTT = state->d2sdT2_constrho();
+		sTd = state->d2sdrhodT();
+	} catch(std::exception &) {
+		return;
+	}
+	if (!ValidNumber(pTT) || !ValidNumber(pTd) || !ValidNumber(pdd) || !ValidNumber(sTT) || !ValidNumber(sTd))
+		return;
+
+	// First derivatives, and their derivatives wrt T (index 0) and d (index 1)
+	const double pT = beta/kappa, pd = 1/(d*kappa);
+	const double pT_[2] = {pTT, pTd}, pd_[2] = {pTd, pdd};
+	const double cv_[2] = {cv/T + T*sTT, T*sTd};
+	const double hT = cv + pT/d, hd = pd/d - T*pT/(d*d);
+	const double hT_[2] = {cv_[0] + pTT/d, cv_[1] + pTd/d - pT/(d*d)};
+	const double hd_[2] = {pTd/d - (pT + T*pTT)/(d*d), pdd/d - (pd + T*pTd)/(d*d) + 2*T*pT/(d*d*d)};
+	const double D = hT*pd - hd*pT;
+	const double a2 = pd + T*pT*pT/(d*d*cv);
+	ExternalThermodynamicState *const derivatives[2] = {derivativesT, derivativesD};
+	for (int i = 0; i < 2; i++){
+		// Derivatives of T and d themselves
+		const double T_ = (i == 0 ? 1.0 : 0.0), d_ = (i == 0 ? 0.0 : 1.0);
+		// kappa = 1/(d p_d)
+		const double kappa_ = -kappa*kappa*(d_*pd + d*pd_[i]);
+		// q = T p_T^2/(d^2 p_d), r = T p_T^2/(d^2 cv)
+		const double q = T*pT*pT/(d*d*pd), r = T*pT*pT/(d*d*cv);
+		const double q_ = (T_*pT + 2*T*pT_[i])*pT/(d*d*pd) - q*(2*d_/d + pd_[i]/pd);
+		const double r_ = (T_*pT + 2*T*pT_[i])*pT/(d*d*cv) - r*(2*d_/d + cv_[i]/cv);
+		const double D_ = hT_[i]*pd + hT*pd_[i] - hd_[i]*pT - hd*pT_[i];
+		derivatives[i]->cv = cv_[i];
+		derivatives[i]->kappa = kappa_;
+		derivatives[i]->beta = pT_[i]*kappa + pT*kappa_;
+		derivatives[i]->cp = cv_[i] + q_;
+		derivatives[i]->a = (pd_[i] + r_)/(2*sqrt(a2));
+		derivatives[i]->ddhp = -(pT_[i]*D - pT*D_)/(D*D);
+		derivatives[i]->ddph = (hT_[i]*D - hT*D_)/(D*D);
+	}
+}
+
 long CoolPropSolver::makeDerivString(const string &of, const string &wrt, const string &cst){
 	std::string derivTerm;
 	     if (!of.compare("d")){ derivTerm = "drho"; }
@@ -2,6 +2,9 @@
 #define COOLPROPSOLVER_H_
 
 #include "basesolver.h"
+#include "criticalband.h"
+
+struct SharedTables;
 
 //! CoolProp solver class
 /*!
@@ -22,27 +25,85 @@
 
   2012-2014
 */
-class CoolPropSolver : public BaseSolver{
+class CoolPropSolver : public BaseSolver, private CriticalBandSource{
 
 protected:
 	class CoolPropStateClassSI *state;
 	bool enable_TTSE, enable_BICUBIC, calc_transport, extend_twophase;
+	bool background_tables; // build the look-up tables on a background thread
+	bool enable_tiles; // interpolate p-h states from a table filled on first access, see tiledtable.h
+	double tiles_dlogp, tiles_dh; // cell size of the tiled table in log(p) and h
+	double tiles_tolerance; // relative tolerance of the cells of the tiled table
+	TiledTable *_tiles; // tiled table shared with the solvers of the same fluid and options, NULL if disabled
+	CriticalBand *_criticalBand; // tables around the critical point, NULL if disabled, see criticalband.h
+	OnceFlag _criticalBandOnce; // set when _criticalBand has been set
+	Mutex _criticalBandMutex; // serializes the publication of _criticalBand
+
+	//! Smoothed two-phase properties at a node of the pressure grid, see smoothedProperties
+	struct SmoothingNode{
+		bool valid;
+		//! Coefficients of x^3, x^2, x and 1 of d, ddhp and ddph, x being the quality
+		double c[3][4];
+	};
+	//! Smoothed two-phase properties of one smoothing option, tabulated on a grid in ln(p)
+	struct SmoothingTable{
+		map<long, SmoothingNode> nodes;
+		//! Intervals between nodes k and k + 1 checked against CoolProp, 1 if they can be interpolated
+		map<long, char> intervals;
+	};
+	enum { SMOOTHING_DERIVATIVES = 0, SMOOTHING_DENSITY = 1 };
+	//! Tables of the options twophase_derivsmoothing_xend and rho_smoothing_xend
+	SmoothingTable _smoothingTables[2];
+	Mutex _smoothingMutex;
+	class CoolPropStateClassSI *_splineState; // state object for the smoothing tables, created on first need and used under _smoothingMutex
 	int debug_level;
 	double twophase_derivsmoothing_xend;
 	double rho_smoothing_xend;
 	long fluidType;
 	double _p_eps   ; // relative tolerance margin for subcritical pressure conditions
-	double _delta_h ; // delta_h for one-phase/two-phase discrimination
 	ExternalSaturationProperties _satPropsClose2Crit; // saturation properties close to  critical conditions
+	OnceFlag _satPropsClose2CritOnce; // set when _satPropsClose2Crit has been computed
+	OnceFlag _tablesOnce; // set when the look-up tables have been built, see initTables
+	SharedTables *_sharedTables; // look-up tables record of the fluid, NULL for fluids without tables
+	std::string _cacheKey; // key of the fluid data in the persistent cache, see fluidcache.h
+	bool _defaultOptions; // true if the substance name has no options
+
+	double psatClose2Crit();
+	void initSatPropsClose2Crit();
+	void initTables();
+	int tableOptions();
+	void setTableOptions();
+	virtual int tableNode(double p, double h, ExternalThermodynamicState *const properties);
+	CriticalBand *criticalBand();
+	virtual bool bandSaturation(double p, ExternalSaturationProperties *const properties);
 
 	virtual void  preStateChange(void);
 	virtual void postStateChange(ExternalThermodynamicState *const properties);
+	void postSatChange(double psat, double Tsat, ExternalSaturationProperties *const properties);
+	void setSat_p_direct(double p, ExternalSaturationProperties *const properties);
+	virtual void setSat_p_newState(ExternalThermodynamicState *const properties, ExternalSaturationProperties *const satProperties);
+	virtual void propertyDerivatives_dT(ExternalThermodynamicState *const properties, ExternalThermodynamicState *const derivativesT,
+		                                ExternalThermodynamicState *const derivativesD);
+	void updateState(int inputChoice, long iInput1, double input1, long iInput2, double input2, int phase, bool neighbour = false);
+	bool leverRule(double p);
+	bool setState_ph_twoPhase(double p, double h, int &phase, ExternalThermodynamicState *const properties);
+	void storeFlashSaturation(double p);
+	static void interpolateSmoothing(SmoothingTable &table, long k, double t, double x, double *values);
+	bool smoothingSample(int option, double p, double x, double *values);
+	bool smoothingInterval(int option, long k);
+	bool smoothedProperties(int option, double p, double x, double &d, double &ddhp, double &ddph);
 	long makeDerivString(const string &of, const string &wrt, const string &cst);
 
 public:
 	CoolPropSolver(const std::string &mediumName, const std::string &libraryName, const std::string &substanceName);
 	~CoolPropSolver();
 	virtual void setFluidConstants();
+	virtual void prepare();
+	virtual bool isReentrant();
+	virtual size_t memoryUsage();
+	virtual TiledTable *tiledTable();
+	static std::string backendVersion();
+	static std::string checkSubstanceName(const std::string &substanceName);
 
 	virtual void setSat_p(double &p, ExternalSaturationProperties *const properties);
 	virtual void setSat_T(double &T, ExternalSaturationProperties *const properties);
@@ -56,6 +117,10 @@ public:
 	virtual void setState_ps(double &p, double &s, int &phase, ExternalThermodynamicState *const properties);
 	virtual void setState_hs(double &h, double &s, int &phase, ExternalThermodynamicState *const properties);
 
+	virtual void setStates(int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+		                   bool ordered, ExternalThermodynamicState *const properties);
+	virtual void setSats(bool byPressure, int n, const double *input, ExternalSaturationProperties *const properties);
+
 	virtual double partialDeriv_state(const string &of, const string &wrt, const string &cst, ExternalThermodynamicState *const properties);
 
 	virtual double Pr(ExternalThermodynamicState *const properties);
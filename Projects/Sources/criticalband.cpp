@@ -0,0 +1,384 @@
+/* *****************************************************************
+ * Implementation of the tables of a band around the critical point
+ ********************************************************************/
+
+#include "criticalband.h"
+#include <stdlib.h>
+#include <math.h>
+
+//! Number of saturation nodes per decade of tau
+static const double nodesPerDecade = 32;
+//! Smallest tau of the saturation nodes
+static const double minimumTau = 1e-6;
+//! Number of cells of the p-h state table across the width of the band, in p and in the latent heat at its start
+static const double stateCells = 64;
+
+//! Saturation properties interpolated by cubic Hermite polynomials, with their derivatives by pressure
+static double ExternalSaturationProperties::*const hermiteFields[][2] = {
+	{&ExternalSaturationProperties::Tsat, &ExternalSaturationProperties::dTp},
+	{&ExternalSaturationProperties::dl, &ExternalSaturationProperties::ddldp},
+	{&ExternalSaturationProperties::dv, &ExternalSaturationProperties::ddvdp},
+	{&ExternalSaturationProperties::hl, &ExternalSaturationProperties::dhldp},
+	{&ExternalSaturationProperties::hv, &ExternalSaturationProperties::dhvdp}
+};
+static const int hermiteFieldCount = sizeof(hermiteFields)/sizeof(hermiteFields[0]);
+
+//! Saturation properties interpolated by power laws in tau
+static double ExternalSaturationProperties::*const powerLawFields[] = {
+	&ExternalSaturationProperties::dTp, &ExternalSaturationProperties::ddldp,
+	&ExternalSaturationProperties::ddvdp, &ExternalSaturationProperties::dhldp,
+	&ExternalSaturationProperties::dhvdp, &ExternalSaturationProperties::sigma
+};
+static const int powerLawFieldCount = sizeof(powerLawFields)/sizeof(powerLawFields[0]);
+
+//! Saturation properties interpolated linearly in p
+static double ExternalSaturationProperties::*const linearFields[] = {
+	&ExternalSaturationProperties::sl, &ExternalSaturationProperties::sv
+};
+static const int linearFieldCount = sizeof(linearFields)/sizeof(linearFields[0]);
+
+static Mutex configurationMutex;
+static bool configured = false;
+static double bandWidth = 0;
+static double bandTolerance = 1e-3;
+
+static Mutex sharedBandsMutex;
+static map<string, CriticalBand*> sharedBands;
+
+//! Interpolate the saturation properties between two nodes
+/*!
+  @param a Node at the lower pressure
+  @param b Node at the higher pressure
+  @param p Pressure between the nodes
+  @param pc Critical pressure
+  @param properties ExternalSaturationProperties property struct
+*/
+static void interpolateSaturation(const ExternalSaturationProperties &a, const ExternalSaturationProperties &b,
+								  double p, double pc, ExternalSaturationProperties *const properties){
+	double H = b.psat - a.psat;
+	double t = (p - a.psat)/H;
+	double h00 = (2*t - 3)*t*t + 1, h10 = ((t - 2)*t + 1)*t, h01 = (3 - 2*t)*t*t, h11 = (t - 1)*t*t;
+	for (int i = 0; i < hermiteFieldCount; i++){
+		double ExternalSaturationProperties::*f = hermiteFields[i][0];
+		double ExternalSaturationProperties::*df = hermiteFields[i][1];
+		properties->*f = h00*(a.*f) + h10*H*(a.*df) + h01*(b.*f) + h11*H*(b.*df);
+	}
+	// Exponent of the power law, from the position in log(tau)
+	double u = log((1 - p/pc)/(1 - a.psat/pc))/log((1 - b.psat/pc)/(1 - a.psat/pc));
+	for (int i = 0; i < powerLawFieldCount; i++){
+		double ExternalSaturationProperties::*f = powerLawFields[i];
+		if (a.*f != 0 && (a.*f > 0) == (b.*f > 0))
+			properties->*f = (a.*f)*pow((b.*f)/(a.*f), u);
+		else
+			properties->*f = (1 - t)*(a.*f) + t*(b.*f);
+	}
+	for (int i = 0; i < linearFieldCount; i++){
+		double ExternalSaturationProperties::*f = linearFields[i];
+		properties->*f = (1 - t)*(a.*f) + t*(b.*f);
+	}
+	properties->psat = p;
+}
+
+//! Find the pressure at which the interpolated saturation temperature is T, by bisection
+/*!
+  @param a Node at the lower pressure
+  @param b Node at the higher pressure
+  @param T Temperature between the temperatures of the nodes
+  @param pc Critical pressure
+*/
+static double interpolatedPressure(const ExternalSaturationProperties &a, const ExternalSaturationProperties &b, double T, double pc){
+	double plo = a.psat, phi = b.psat;
+	ExternalSaturationProperties interpolated;
+	for (int i = 0; i < 60 && phi - plo > 1e-12*phi; i++){
+		double p = 0.5*(plo + phi);
+		interpolateSaturation(a, b, p, pc, &interpolated);
+		if (interpolated.Tsat <= T)
+			plo = p;
+		else
+			phi = p;
+	}
+	return 0.5*(plo + phi);
+}
+
+//! Return true if the interpolated saturation properties are within the tolerance of the exact ones
+/*!
+  All the properties served by the band are checked, relative to their
+  value; enthalpies and entropies may be close to zero, hence an absolute
+  scale of 1 J/kg or J/(kg.K) for them.
+*/
+static bool withinTolerance(const ExternalSaturationProperties &interpolated, const ExternalSaturationProperties &exact, double tolerance){
+	static double ExternalSaturationProperties::*const relativeFields[] = {
+		&ExternalSaturationProperties::Tsat, &ExternalSaturationProperties::dTp,
+		&ExternalSaturationProperties::ddldp, &ExternalSaturationProperties::ddvdp,
+		&ExternalSaturationProperties::dhldp, &ExternalSaturationProperties::dhvdp,
+		&ExternalSaturationProperties::dl, &ExternalSaturationProperties::dv,
+		&ExternalSaturationProperties::sigma
+	};
+	static double ExternalSaturationProperties::*const offsetFields[] = {
+		&ExternalSaturationProperties::hl, &ExternalSaturationProperties::hv,
+		&ExternalSaturationProperties::sl, &ExternalSaturationProperties::sv
+	};
+	for (unsigned int i = 0; i < sizeof(relativeFields)/sizeof(relativeFields[0]); i++){
+		double ExternalSaturationProperties::*f = relativeFields[i];
+		// Properties not computed by the source (NaN) are not checked
+		if (exact.*f == exact.*f && !(fabs(interpolated.*f - exact.*f) <= tolerance*fabs(exact.*f)))
+			return false;
+	}
+	for (unsigned int i = 0; i < sizeof(offsetFields)/sizeof(offsetFields[0]); i++){
+		double ExternalSaturationProperties::*f = offsetFields[i];
+		if (exact.*f == exact.*f && !(fabs(interpolated.*f - exact.*f) <= tolerance*(fabs(exact.*f) + 1.0)))
+			return false;
+	}
+	return true;
+}
+
+//! Constructor
+/*!
+  The tables are computed on first use.
+  @param pc Critical pressure
+  @param width Reduced distance 1 - p/pc of the lowest saturation node, and half width of the state table
+  @param tolerance Relative tolerance of the interpolated properties
+*/
+CriticalBand::CriticalBand(double pc, double width, double tolerance)
+	: _pc(pc), _width(width), _tolerance(tolerance), _ratio(pow(10.0, 1/nodesPerDecade)),
+	  _states(NULL), _building(false), _references(0){
+}
+
+//! Destructor
+CriticalBand::~CriticalBand(){
+	delete _states;
+}
+
+//! Compute the saturation properties at a pressure in the band
+/*!
+  @param p Pressure
+  @param source Source of the nodes
+  @param properties ExternalSaturationProperties property struct
+  @return False if the pressure is outside the band or in a segment left to the source
+*/
+bool CriticalBand::setSat_p(double p, CriticalBandSource &source, ExternalSaturationProperties *const properties){
+	if (!(1 - p/_pc < _width) || !ready(source))
+		return false;
+	int n = (int)_nodes.size();
+	if (n == 0 || p < _nodes[0].psat)
+		return false;
+	if (p >= _nodes[n - 1].psat){
+		*properties = _nodes[n - 1];
+		return true;
+	}
+	int k = (int)(log(_width/(1 - p/_pc))/log(_ratio));
+	k = k < 0 ? 0 : (k > n - 2 ? n - 2 : k);
+	// Correct rounding errors of the estimate
+	while (k > 0 && p < _nodes[k].psat)
+		k--;
+	while (k < n - 2 && p > _nodes[k + 1].psat)
+		k++;
+	if (!_segments[k])
+		return false;
+	interpolateSaturation(_nodes[k], _nodes[k + 1], p, _pc, properties);
+	return true;
+}
+
+//! Compute the saturation properties at a temperature in the band
+/*!
+  The pressure is found by bisection on the interpolated saturation
+  temperature.
+  @param T Temperature
+  @param source Source of the nodes
+  @param properties ExternalSaturationProperties property struct
+  @return False if the temperature is outside the band or in a segment left to the source
+*/
+bool CriticalBand::setSat_T(double T, CriticalBandSource &source, ExternalSaturationProperties *const properties){
+	if (!ready(source))
+		return false;
+	int n = (int)_nodes.size();
+	if (n == 0 || T < _nodes[0].Tsat)
+		return false;
+	if (T >= _nodes[n - 1].Tsat){
+		*properties = _nodes[n - 1];
+		return true;
+	}
+	int lo = 0, hi = n - 1;
+	while (hi - lo > 1){
+		int mid = (lo + hi)/2;
+		if (_nodes[mid].Tsat <= T)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (!_segments[lo])
+		return false;
+	interpolateSaturation(_nodes[lo], _nodes[hi], interpolatedPressure(_nodes[lo], _nodes[hi], T, _pc), _pc, properties);
+	properties->Tsat = T;
+	return true;
+}
+
+//! Interpolate a p-h state in the band
+/*!
+  @param p Pressure
+  @param h Specific enthalpy
+  @param source Source of the nodes
+  @param properties ExternalThermodynamicState property struct
+  @return False if the state is outside the band or in a cell left to the source
+*/
+bool CriticalBand::setState_ph(double p, double h, CriticalBandSource &source, ExternalThermodynamicState *const properties){
+	if (!(fabs(1 - p/_pc) < _width) || !ready(source) || _states == NULL)
+		return false;
+	return _states->lookup(p, h, source, properties);
+}
+
+//! Make sure the saturation nodes have been computed
+/*!
+  The first thread computes them; the others get false meanwhile and use
+  the source directly.
+  @param source Source of the nodes
+*/
+bool CriticalBand::ready(CriticalBandSource &source){
+	if (_built.done())
+		return true;
+	{
+		ScopedLock lock(_mutex);
+		if (_building)
+			return false;
+		_building = true;
+	}
+	build(source);
+	return true;
+}
+
+//! Compute the saturation nodes and create the state table
+/*!
+  Called without the band locked, by the only thread that set the building
+  flag. The nodes end at the first pressure the source cannot compute.
+  @param source Source of the nodes
+*/
+void CriticalBand::build(CriticalBandSource &source){
+	std::vector<ExternalSaturationProperties> nodes;
+	for (double tau = _width; tau >= minimumTau; tau /= _ratio){
+		ExternalSaturationProperties node;
+		if (!source.bandSaturation(_pc*(1 - tau), &node))
+			break;
+		node.psat = _pc*(1 - tau);
+		nodes.push_back(node);
+	}
+
+	// Each segment is checked at a quarter, the middle and three quarters of
+	// its length in log(tau), for setSat_p and for the pressure setSat_T finds
+	std::vector<char> segments(nodes.size() > 1 ? nodes.size() - 1 : 0);
+	for (unsigned int k = 0; k + 1 < nodes.size(); k++){
+		double taua = 1 - nodes[k].psat/_pc, taub = 1 - nodes[k + 1].psat/_pc;
+		bool ok = true;
+		for (int i = 1; i <= 3 && ok; i++){
+			double p = _pc*(1 - taua*pow(taub/taua, i/4.0));
+			ExternalSaturationProperties exact, interpolated;
+			ok = source.bandSaturation(p, &exact);
+			if (ok){
+				interpolateSaturation(nodes[k], nodes[k + 1], p, _pc, &interpolated);
+				ok = withinTolerance(interpolated, exact, _tolerance);
+			}
+			if (ok && exact.Tsat > nodes[k].Tsat && exact.Tsat < nodes[k + 1].Tsat)
+				ok = fabs(interpolatedPressure(nodes[k], nodes[k + 1], exact.Tsat, _pc) - p) <= _tolerance*p;
+		}
+		segments[k] = ok;
+	}
+
+	// Cells scaled by the width of the band in p and by the latent heat at its start in h
+	TiledTable *states = NULL;
+	if (!nodes.empty() && nodes[0].hv > nodes[0].hl)
+		states = new TiledTable(_width/stateCells, (nodes[0].hv - nodes[0].hl)/stateCells, 8, _tolerance);
+
+	ScopedLock lock(_mutex);
+	_nodes.swap(nodes);
+	_segments.swap(segments);
+	_states = states;
+	_building = false;
+	_built.setDone();
+}
+
+//! Configure the bands created afterwards
+/*!
+  @param width Reduced distance 1 - p/pc of the start of the band, 0 to disable the band
+  @param tolerance Relative tolerance of the interpolated properties, not changed if not positive
+*/
+void CriticalBand::configure(double width, double tolerance){
+	ScopedLock lock(configurationMutex);
+	bandWidth = width;
+	if (tolerance > 0)
+		bandTolerance = tolerance;
+	configured = true;
+}
+
+//! Return the band shared by the solvers of a fluid, NULL if the band is disabled
+/*!
+  Each call returning a band takes a reference to it, which must be given
+  back with release() when the caller is deleted.
+  @param key Key of the fluid, holding the library and the substance name with its options
+  @param pc Critical pressure
+*/
+CriticalBand *CriticalBand::shared(const string &key, double pc){
+	double width, tolerance;
+	{
+		ScopedLock lock(configurationMutex);
+		if (!configured){
+			const char *environment = getenv("EXTERNALMEDIA_CRITICAL_BAND");
+			if (environment)
+				bandWidth = strtod(environment, NULL);
+			environment = getenv("EXTERNALMEDIA_CRITICAL_BAND_TOL");
+			if (environment && strtod(environment, NULL) > 0)
+				bandTolerance = strtod(environment, NULL);
+			configured = true;
+		}
+		width = bandWidth;
+		tolerance = bandTolerance;
+	}
+	if (!(width > 0 && width < 1) || !(pc > 0))
+		return NULL;
+	ScopedLock lock(sharedBandsMutex);
+	map<string, CriticalBand*>::iterator it = sharedBands.find(key);
+	if (it != sharedBands.end()){
+		it->second->_references++;
+		return it->second;
+	}
+	CriticalBand *band = new CriticalBand(pc, width, tolerance);
+	band->_key = key;
+	band->_references = 1;
+	sharedBands[key] = band;
+	return band;
+}
+
+//! Give back a reference to a shared band
+/*!
+  The band is deleted when its last user releases it.
+  @param band Band returned by shared(), NULL is ignored
+*/
+void CriticalBand::release(CriticalBand *band){
+	if (band == NULL)
+		return;
+	{
+		ScopedLock lock(sharedBandsMutex);
+		if (--band->_references > 0)
+			return;
+		sharedBands.erase(band->_key);
+	}
+	delete band;
+}
+
+//! Estimate the share of the memory of the band used by one of its users
+/*!
+  The memory of the nodes and of the state table divided by the number of
+  users of the band, so that the shares of all the solvers using the band
+  add up to its memory.
+*/
+size_t CriticalBand::memoryShare(){
+	size_t bytes = sizeof(*this);
+	TiledTable *states;
+	{
+		ScopedLock lock(_mutex);
+		bytes += _nodes.capacity()*sizeof(ExternalSaturationProperties) + _segments.capacity();
+		states = _states;
+	}
+	if (states != NULL)
+		bytes += states->memoryUsage();
+	ScopedLock lock(sharedBandsMutex);
+	return bytes/(_references > 0 ? _references : 1);
+}
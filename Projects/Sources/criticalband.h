@@ -0,0 +1,105 @@
+/*!
+  \file criticalband.h
+  \brief Tables of a band around the critical point
+
+  Saturation properties close to the critical point are slow and hard to
+  converge, so the solvers used to return a single record computed at
+  pc*(1 - p_eps) for all the pressures above it. A critical band replaces
+  this with tables in the reduced distance tau = 1 - p/pc to the critical
+  pressure, from tau = width down to the closest pressure the source can
+  compute:
+
+  - saturation records at nodes spaced logarithmically in tau, interpolated
+    by cubic Hermite polynomials in p for the properties whose derivatives
+    by pressure are part of the record, by power laws in tau for these
+    derivatives and the surface tension, and linearly for the entropies;
+    each segment is checked against the source at three points, for all
+    the properties of the record and for the pressure found by setSat_T,
+    and the segments exceeding the tolerance are left to the source;
+  - a fine TiledTable of p-h states for |1 - p/pc| < width, whose cells
+    are checked at their centre for all the interpolated properties.
+
+  The checks bound the error at the checked points only; in between, the
+  error is assumed not to exceed the checked one by much, which holds for
+  the smooth properties of the record and the small segments and cells.
+
+  Above the last node the record of the last node is returned, as the
+  solvers did above pc*(1 - p_eps), but much closer to pc.
+
+  The band is disabled unless a width is set with the environment variable
+  EXTERNALMEDIA_CRITICAL_BAND (e.g. 0.05) or with configure(); the relative
+  tolerance is taken from EXTERNALMEDIA_CRITICAL_BAND_TOL (default 1e-3).
+  The settings apply to the bands created afterwards.
+*/
+
+#ifndef CRITICALBAND_H_
+#define CRITICALBAND_H_
+
+#include "include.h"
+#include "externalmedialib.h"
+#include "threading.h"
+#include "tiledtable.h"
+#include <vector>
+
+//! Source of the nodes of a CriticalBand
+class CriticalBandSource : public TiledTableSource{
+public:
+	//! Compute the saturation properties at a pressure
+	/*!
+	  Must not report errors.
+	  @param p Pressure
+	  @param properties ExternalSaturationProperties property struct
+	  @return False if the properties could not be computed
+	*/
+	virtual bool bandSaturation(double p, ExternalSaturationProperties *const properties) = 0;
+};
+
+//! Tables of a band around the critical point
+class CriticalBand{
+public:
+	CriticalBand(double pc, double width, double tolerance);
+	~CriticalBand();
+
+	bool setSat_p(double p, CriticalBandSource &source, ExternalSaturationProperties *const properties);
+	bool setSat_T(double T, CriticalBandSource &source, ExternalSaturationProperties *const properties);
+	bool setState_ph(double p, double h, CriticalBandSource &source, ExternalThermodynamicState *const properties);
+
+	size_t memoryShare();
+
+	static void configure(double width, double tolerance);
+	static CriticalBand *shared(const string &key, double pc);
+	static void release(CriticalBand *band);
+
+private:
+	bool ready(CriticalBandSource &source);
+	void build(CriticalBandSource &source);
+
+	//! Critical pressure
+	double _pc;
+	//! Reduced distance tau = 1 - p/pc of the first node
+	double _width;
+	//! Relative tolerance of the checks
+	double _tolerance;
+	//! Ratio of the tau of consecutive nodes
+	double _ratio;
+	//! Saturation records at the nodes, by increasing pressure
+	std::vector<ExternalSaturationProperties> _nodes;
+	//! Flags of the segments between consecutive nodes that can be interpolated
+	std::vector<char> _segments;
+	//! Table of the p-h states
+	TiledTable *_states;
+	//! Set when the nodes have been computed
+	OnceFlag _built;
+	//! Set while a thread is computing the nodes
+	bool _building;
+	Mutex _mutex;
+	//! Key and number of users of a shared band, protected by the lock of the shared bands
+	string _key;
+	int _references;
+
+	// Bands cannot be copied
+	CriticalBand(const CriticalBand &);
+	CriticalBand &operator=(const CriticalBand &);
+};
+
+#endif // CRITICALBAND_H_
@@ -2,12 +2,15 @@
  * Implementation of the error reporting functions
  *
  * The actual implementation depends on the selected preprocessor
- * variable defined in include.h
+ * variable defined in include.h. Messages raised during a parallel
+ * batch are collected by the thread pool and reported afterwards on
+ * the calling thread.
  * 
  * Francesco Casella, Christoph Richter, Nov 2006
  ********************************************************************/
 
 #include "errorhandling.h"
+#include "threadpool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,21 +19,29 @@
 #if (BUILD_DLL == 0)
 // This implementation uses the native Modelica tool log and error window to report errors
 void errorMessage(char *errorMessage){
+	if (ThreadPool::deferMessage(true, errorMessage))
+		return;
 	ModelicaError(errorMessage);
 }
 
 void warningMessage(char *warningMessage){
+	if (ThreadPool::deferMessage(false, warningMessage))
+		return;
 	ModelicaMessage(warningMessage);
 }
 #else
 // The Dymola specific implementation does currently not work for dynmic link libraries
 void errorMessage(char *errorMessage){
+	if (ThreadPool::deferMessage(true, errorMessage))
+		return;
 	printf("\a%s\nPress the Stop button in Dymola to end the simulation!\n", errorMessage);
 	getchar();
 	exit(1);
 }
 
 void warningMessage(char *warningMessage){
+	if (ThreadPool::deferMessage(false, warningMessage))
+		return;
 	strcat(warningMessage, "\n");
 	printf("%s",warningMessage);
 }
@@ -39,12 +50,16 @@ void warningMessage(char *warningMessage){
 // This is the default section
 // Error and warnings are sent to the standard output
 void errorMessage(char *errorMessage){
+	if (ThreadPool::deferMessage(true, errorMessage))
+		return;
 	printf("\a%s\nPress the stop button in Dymola to end the simulation!\n", errorMessage);
 	getchar();
 	exit(1);
 }
 
 void warningMessage(char *warningMessage){
+	if (ThreadPool::deferMessage(false, warningMessage))
+		return;
 	strcat(warningMessage, "\n");
 	printf("%s",warningMessage);
 }
@@ -6,6 +6,12 @@
 #include "externalmedialib.h"
 #include "basesolver.h"
 #include "solvermap.h"
+#include "fluidcache.h"
+#include "parallelbatch.h"
+#include "prewarm.h"
+#include "threadpool.h"
+#include "tiledtable.h"
+#include "criticalband.h"
 #include <math.h>
 
 //! Get molar mass
@@ -71,6 +77,7 @@ void TwoPhaseMedium_setState_ph_C_impl(double p, double h, int phase, ExternalTh
 								 const char *mediumName, const char *libraryName, const char *substanceName){
 	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
     solver->setState_ph(p, h, phase, state);
+	solver->storeLastState(CHOICE_ph, p, h, phase, *state);
 }
 
 //! Compute properties from p and T
@@ -89,6 +96,7 @@ void TwoPhaseMedium_setState_pT_C_impl(double p, double T, ExternalThermodynamic
 								 const char *mediumName, const char *libraryName, const char *substanceName){
 	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
     solver->setState_pT(p, T, state);
+	solver->storeLastState(CHOICE_pT, p, T, 0, *state);
 }
 
 //! Compute properties from d, T, and phase
@@ -106,6 +114,7 @@ void TwoPhaseMedium_setState_dT_C_impl(double d, double T, int phase, ExternalTh
 								 const char *mediumName, const char *libraryName, const char *substanceName){
 	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
     solver->setState_dT(d, T, phase, state);
+	solver->storeLastState(CHOICE_dT, d, T, phase, *state);
 }
 
 //! Compute properties from p, s, and phase
@@ -123,6 +132,7 @@ void TwoPhaseMedium_setState_ps_C_impl(double p, double s, int phase, ExternalTh
 								 const char *mediumName, const char *libraryName, const char *substanceName){
 	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
     solver->setState_ps(p, s, phase, state);
+	solver->storeLastState(CHOICE_ps, p, s, phase, *state);
 }
 
 //! Compute properties from h, s, and phase
@@ -140,6 +150,1189 @@ void TwoPhaseMedium_setState_hs_C_impl(double h, double s, int phase, ExternalTh
 								 const char *mediumName, const char *libraryName, const char *substanceName){
 	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
     solver->setState_hs(h, s, phase, state);
+	solver->storeLastState(CHOICE_hs, h, s, phase, *state);
+}
+
+//! Compute the time derivative of the state record from p, h, and phase
+/*!
+  This function computes the time derivative of the state record for the
+  specified inputs and input derivatives, see BaseSolver::setState_der.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param p_der Time derivative of pressure
+  @param h_der Time derivative of specific enthalpy
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ph_der_C_impl(double p, double h, int phase, double p_der, double h_der, ExternalThermodynamicState *state_der,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_der(CHOICE_ph, p, h, phase, p_der, h_der, state_der);
+}
+
+//! Compute the time derivative of the state record from p, T, and phase
+/*!
+  This function computes the time derivative of the state record for the
+  specified inputs and input derivatives, see BaseSolver::setState_der.
+  @param p Pressure
+  @param T Temperature
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param p_der Time derivative of pressure
+  @param T_der Time derivative of temperature
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_pT_der_C_impl(double p, double T, int phase, double p_der, double T_der, ExternalThermodynamicState *state_der,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_der(CHOICE_pT, p, T, phase, p_der, T_der, state_der);
+}
+
+//! Compute the time derivative of the state record from d, T, and phase
+/*!
+  This function computes the time derivative of the state record for the
+  specified inputs and input derivatives, see BaseSolver::setState_der.
+  @param d Density
+  @param T Temperature
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param d_der Time derivative of density
+  @param T_der Time derivative of temperature
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_dT_der_C_impl(double d, double T, int phase, double d_der, double T_der, ExternalThermodynamicState *state_der,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_der(CHOICE_dT, d, T, phase, d_der, T_der, state_der);
+}
+
+//! Compute the time derivative of the state record from p, s, and phase
+/*!
+  This function computes the time derivative of the state record for the
+  specified inputs and input derivatives, see BaseSolver::setState_der.
+  @param p Pressure
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param p_der Time derivative of pressure
+  @param s_der Time derivative of specific entropy
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ps_der_C_impl(double p, double s, int phase, double p_der, double s_der, ExternalThermodynamicState *state_der,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_der(CHOICE_ps, p, s, phase, p_der, s_der, state_der);
+}
+
+//! Compute the time derivative of the state record from h, s, and phase
+/*!
+  This function computes the time derivative of the state record for the
+  specified inputs and input derivatives, see BaseSolver::setState_der.
+  @param h Specific enthalpy
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param h_der Time derivative of specific enthalpy
+  @param s_der Time derivative of specific entropy
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_hs_der_C_impl(double h, double s, int phase, double h_der, double s_der, ExternalThermodynamicState *state_der,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_der(CHOICE_hs, h, s, phase, h_der, s_der, state_der);
+}
+
+//! Create a context
+/*!
+  This function creates an empty context, which owns its own solvers,
+  caches and statistics. Contexts let several simulations run in the same
+  process (e.g. FMU instances driven by a co-simulation master) without
+  sharing any solver state; the returned handle is passed to
+  TwoPhaseMedium_bindContext_C_impl before calling the other functions.
+*/
+void *TwoPhaseMedium_createContext_C_impl(void){
+	return new SolverMap();
+}
+
+//! Destroy a context
+/*!
+  This function deletes all the solvers of the context and releases their
+  memory. The context must not be in use by any other thread; it is
+  unbound from the calling thread if needed.
+  @param context Context handle returned by TwoPhaseMedium_createContext_C_impl
+*/
+void TwoPhaseMedium_destroyContext_C_impl(void *context){
+	if (context == NULL)
+		return;
+	if (SolverMap::current() == context)
+		SolverMap::bind(NULL);
+	delete (SolverMap*)context;
+}
+
+//! Bind a context to the calling thread
+/*!
+  This function makes the calling thread use the solvers of the given
+  context in all the subsequent calls, and returns the previously bound
+  context so that it can be restored. Threads without a bound context use
+  the default context of the process.
+  @param context Context handle, NULL for the default context
+*/
+void *TwoPhaseMedium_bindContext_C_impl(void *context){
+	return SolverMap::bind((SolverMap*)context);
+}
+
+//! Bind a context to the calling thread, for Modelica
+/*!
+  Same as TwoPhaseMedium_bindContext_C_impl, without returning the
+  previous context, since Modelica functions cannot return handles.
+  @param context Context handle
+*/
+void TwoPhaseMedium_useContext_C_impl(void *context){
+	SolverMap::bind((SolverMap*)context);
+}
+
+//! Bind the default context to the calling thread, for Modelica
+/*!
+  Modelica functions cannot pass a NULL handle to
+  TwoPhaseMedium_useContext_C_impl.
+*/
+void TwoPhaseMedium_useDefaultContext_C_impl(void){
+	SolverMap::bind(NULL);
+}
+
+//! Acquire a reference to a solver
+/*!
+  This function creates the solver of the specified medium if needed and
+  keeps it until the reference is released with
+  TwoPhaseMedium_releaseSolver_C_impl. Returns the new reference count.
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+int TwoPhaseMedium_acquireSolver_C_impl(const char *mediumName, const char *libraryName, const char *substanceName){
+	return SolverMap::current()->acquire(mediumName, libraryName, substanceName);
+}
+
+//! Release a reference to a solver
+/*!
+  This function decrements the reference count of the solver of the
+  specified medium, and deletes the solver with all its caches when no
+  reference is left; a solver that was never acquired is deleted right
+  away. It is created again if it is used later. Returns the remaining
+  reference count.
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+int TwoPhaseMedium_releaseSolver_C_impl(const char *mediumName, const char *libraryName, const char *substanceName){
+	return SolverMap::current()->release(libraryName, substanceName);
+}
+
+//! Release all the solvers
+/*!
+  This function deletes all the solvers of the context bound to the
+  calling thread, regardless of their reference counts.
+*/
+void TwoPhaseMedium_releaseAll_C_impl(void){
+	SolverMap::current()->releaseAll();
+}
+
+//! Return the memory used by a solver
+/*!
+  This function returns an estimate of the memory in bytes used by the
+  solver of the specified medium, excluding its worker instances, or 0 if
+  the medium has not been used in the current context.
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+long TwoPhaseMedium_getMemoryUsage_C_impl(const char *mediumName, const char *libraryName, const char *substanceName){
+	return (long)SolverMap::current()->memoryUsage(libraryName, substanceName);
+}
+
+//! Return a report of the memory used by all solvers
+/*!
+  This function writes one line per solver of the current context, with
+  the estimated memory in bytes and the reference count, followed by the
+  total. Returns the length of the full report, which is truncated if it
+  does not fit in the buffer.
+  @param report Buffer for the report
+  @param size Size of the buffer
+*/
+int TwoPhaseMedium_getMemoryReport_C_impl(char *report, int size){
+	string text(SolverMap::current()->memoryReport());
+	if (size > 0){
+		strncpy(report, text.c_str(), size - 1);
+		report[size - 1] = '\0';
+	}
+	return (int)text.size();
+}
+
+//! Configure the parallel evaluation of batched calls
+/*!
+  This function sets the number of threads and the minimum number of
+  elements per thread used by the setStates_xx and setSats_xx functions.
+  The defaults are taken from the environment variables
+  EXTERNALMEDIA_THREADS and EXTERNALMEDIA_MIN_CHUNK.
+  @param threads Number of threads including the calling one, not changed if not positive
+  @param minChunk Minimum number of elements per thread, not changed if not positive
+*/
+void TwoPhaseMedium_setParallelOptions_C_impl(int threads, int minChunk){
+	ThreadPool::instance().configure(threads, minChunk);
+}
+
+//! Set the directory of the persistent fluid data cache
+/*!
+  Fluid constants and near-critical saturation properties are stored in
+  this directory and reused by later processes (see fluidcache.h). The
+  default is taken from the environment variable EXTERNALMEDIA_CACHE_DIR.
+  @param directory Existing directory, empty string to disable the cache
+*/
+void TwoPhaseMedium_setCacheDirectory_C_impl(const char *directory){
+	FluidCache::setDirectory(directory);
+}
+
+//! Configure the tables around the critical point
+/*!
+  Saturation properties and p-h states with a pressure within width*pc of
+  the critical pressure are interpolated from tables checked against the
+  equation of state (see criticalband.h). The settings apply to the media
+  used for the first time afterwards. The defaults are taken from the
+  environment variables EXTERNALMEDIA_CRITICAL_BAND and
+  EXTERNALMEDIA_CRITICAL_BAND_TOL.
+  @param width Reduced distance 1 - p/pc of the start of the band, 0 to disable the band
+  @param tolerance Relative tolerance of the interpolated properties, not changed if not positive
+*/
+void TwoPhaseMedium_setCriticalBand_C_impl(double width, double tolerance){
+	CriticalBand::configure(width, tolerance);
+}
+
+//! Prepare solvers before the simulation starts
+/*!
+  This function creates the solvers of the listed media in the current
+  context and computes their constants, near-critical saturation
+  properties and look-up tables concurrently on the thread pool, instead
+  of on first use during the initialisation of the model. Returns the
+  number of solvers.
+  @param media List of media, e.g. "CoolProp:Water;CoolProp:R134a", see prewarm.h
+*/
+int TwoPhaseMedium_prewarm_C_impl(const char *media){
+	return prewarmSolvers(media);
+}
+
+//! Compute properties from arrays of p, h, and phase
+/*!
+  This function computes the properties for n elements with the same
+  medium. The solver is looked up once for the whole batch, and large
+  batches are evaluated in parallel (see parallelbatch.h).
+  @param n Number of elements
+  @param p Array of pressures
+  @param h Array of specific enthalpies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param state Array of n ExternalThermodynamicState structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_ph_C_impl(int n, const double *p, const double *h, const int *phase, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesParallel(mediumName, libraryName, substanceName, CHOICE_ph, n, p, h, phase, false, state);
+}
+
+//! Compute properties from arrays of p and T
+/*!
+  This function computes the properties for n elements with the same
+  medium. The solver is looked up once for the whole batch, and large
+  batches are evaluated in parallel (see parallelbatch.h).
+  @param n Number of elements
+  @param p Array of pressures
+  @param T Array of temperatures
+  @param state Array of n ExternalThermodynamicState structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_pT_C_impl(int n, const double *p, const double *T, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesParallel(mediumName, libraryName, substanceName, CHOICE_pT, n, p, T, NULL, false, state);
+}
+
+//! Compute properties from arrays of d, T, and phase
+/*!
+  This function computes the properties for n elements with the same
+  medium. The solver is looked up once for the whole batch, and large
+  batches are evaluated in parallel (see parallelbatch.h).
+  @param n Number of elements
+  @param d Array of densities
+  @param T Array of temperatures
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param state Array of n ExternalThermodynamicState structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_dT_C_impl(int n, const double *d, const double *T, const int *phase, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesParallel(mediumName, libraryName, substanceName, CHOICE_dT, n, d, T, phase, false, state);
+}
+
+//! Compute properties from arrays of p, s, and phase
+/*!
+  This function computes the properties for n elements with the same
+  medium. The solver is looked up once for the whole batch, and large
+  batches are evaluated in parallel (see parallelbatch.h).
+  @param n Number of elements
+  @param p Array of pressures
+  @param s Array of specific entropies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param state Array of n ExternalThermodynamicState structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_ps_C_impl(int n, const double *p, const double *s, const int *phase, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesParallel(mediumName, libraryName, substanceName, CHOICE_ps, n, p, s, phase, false, state);
+}
+
+//! Compute properties from arrays of h, s, and phase
+/*!
+  This function computes the properties for n elements with the same
+  medium. The solver is looked up once for the whole batch, and large
+  batches are evaluated in parallel (see parallelbatch.h).
+  @param n Number of elements
+  @param h Array of specific enthalpies
+  @param s Array of specific entropies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param state Array of n ExternalThermodynamicState structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_hs_C_impl(int n, const double *h, const double *s, const int *phase, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesParallel(mediumName, libraryName, substanceName, CHOICE_hs, n, h, s, phase, false, state);
+}
+
+//! Compute properties from arrays of p, h, and phase of consecutive cells
+/*!
+  This function computes the properties for n elements with the same
+  medium, which are consecutive cells of a 1-D discretization, e.g. of a
+  pipe or heat exchanger. The cells are processed in order and each flash
+  is started from the solution of the previous cell.
+  @param n Number of elements
+  @param p Array of pressures
+  @param h Array of specific enthalpies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param state Array of n ExternalThermodynamicState structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_ph_ordered_C_impl(int n, const double *p, const double *h, const int *phase, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesParallel(mediumName, libraryName, substanceName, CHOICE_ph, n, p, h, phase, true, state);
+}
+
+//! Compute properties from arrays of p, h, and phase of consecutive cells, field by field
+/*!
+  Same as TwoPhaseMedium_setStates_ph_ordered_C_impl, but the results are
+  returned in one array per property, as required by the Modelica function
+  setStates_ph. The pressure and specific enthalpy are not returned, since
+  they are equal to the inputs.
+  @param n Number of elements
+  @param p Array of pressures
+  @param h Array of specific enthalpies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param T Array of temperatures
+  @param a Array of velocities of sound
+  @param beta Array of isobaric expansion coefficients
+  @param cp Array of specific heat capacities cp
+  @param cv Array of specific heat capacities cv
+  @param d Array of densities
+  @param ddhp Array of derivatives of density wrt enthalpy at constant pressure
+  @param ddph Array of derivatives of density wrt pressure at constant enthalpy
+  @param eta Array of dynamic viscosities
+  @param kappa Array of compressibilities
+  @param lambda Array of thermal conductivities
+  @param phaseOut Array of phase flags of the states
+  @param s Array of specific entropies
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_ph_ordered_fields_C_impl(int n, const double *p, const double *h, const int *phase,
+									 double *T, double *a, double *beta, double *cp, double *cv, double *d, double *ddhp, double *ddph,
+									 double *eta, double *kappa, double *lambda, int *phaseOut, double *s,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	ExternalThermodynamicStateArrays states = {T, a, beta, cp, cv, d, ddhp, ddph, eta, NULL, kappa, lambda, NULL, phaseOut, s};
+	setStatesArraysParallel(mediumName, libraryName, substanceName, CHOICE_ph, n, p, h, phase, true, states);
+}
+
+//! Compute properties from arrays of p, h, and phase, field by field
+/*!
+  Same as TwoPhaseMedium_setStates_ph_ordered_fields_C_impl, but the
+  elements are only treated as consecutive cells if ordered is not zero,
+  see TwoPhaseMedium_setStates_ph_C_impl otherwise.
+  @param n Number of elements
+  @param p Array of pressures
+  @param h Array of specific enthalpies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param ordered Non-zero if consecutive elements are neighbours
+  @param T Array of temperatures
+  @param a Array of velocities of sound
+  @param beta Array of isobaric expansion coefficients
+  @param cp Array of specific heat capacities cp
+  @param cv Array of specific heat capacities cv
+  @param d Array of densities
+  @param ddhp Array of derivatives of density wrt enthalpy at constant pressure
+  @param ddph Array of derivatives of density wrt pressure at constant enthalpy
+  @param eta Array of dynamic viscosities
+  @param kappa Array of compressibilities
+  @param lambda Array of thermal conductivities
+  @param phaseOut Array of phase flags of the states
+  @param s Array of specific entropies
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_ph_fields_C_impl(int n, const double *p, const double *h, const int *phase, int ordered,
+									 double *T, double *a, double *beta, double *cp, double *cv, double *d, double *ddhp, double *ddph,
+									 double *eta, double *kappa, double *lambda, int *phaseOut, double *s,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	ExternalThermodynamicStateArrays states = {T, a, beta, cp, cv, d, ddhp, ddph, eta, NULL, kappa, lambda, NULL, phaseOut, s};
+	setStatesArraysParallel(mediumName, libraryName, substanceName, CHOICE_ph, n, p, h, phase, ordered != 0, states);
+}
+
+//! Compute properties from arrays of p, s, and phase of consecutive cells
+/*!
+  This function computes the properties for n elements with the same
+  medium, which are consecutive cells of a 1-D discretization, e.g. of a
+  pipe or heat exchanger. The cells are processed in order and each flash
+  is started from the solution of the previous cell.
+  @param n Number of elements
+  @param p Array of pressures
+  @param s Array of specific entropies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param state Array of n ExternalThermodynamicState structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_ps_ordered_C_impl(int n, const double *p, const double *s, const int *phase, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesParallel(mediumName, libraryName, substanceName, CHOICE_ps, n, p, s, phase, true, state);
+}
+
+//! Compute properties from arrays of h, s, and phase of consecutive cells
+/*!
+  This function computes the properties for n elements with the same
+  medium, which are consecutive cells of a 1-D discretization, e.g. of a
+  pipe or heat exchanger. The cells are processed in order and each flash
+  is started from the solution of the previous cell.
+  @param n Number of elements
+  @param h Array of specific enthalpies
+  @param s Array of specific entropies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param state Array of n ExternalThermodynamicState structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_hs_ordered_C_impl(int n, const double *h, const double *s, const int *phase, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesParallel(mediumName, libraryName, substanceName, CHOICE_hs, n, h, s, phase, true, state);
+}
+
+//! Compute properties from arrays of p, h, and phase into separate arrays per property
+/*!
+  This function computes the properties for n elements with the same
+  medium and writes them to the non-NULL arrays of the output descriptor.
+  Properties without an output array are not computed.
+  @param n Number of elements
+  @param p Array of pressures
+  @param h Array of specific enthalpies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param ordered Non-zero if the elements are consecutive cells of a 1-D discretization
+  @param states Output arrays
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_ph_arrays_C_impl(int n, const double *p, const double *h, const int *phase, int ordered, const ExternalThermodynamicStateArrays *states,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesArraysParallel(mediumName, libraryName, substanceName, CHOICE_ph, n, p, h, phase, ordered != 0, *states);
+}
+
+//! Compute properties from arrays of p and T into separate arrays per property
+/*!
+  This function computes the properties for n elements with the same
+  medium and writes them to the non-NULL arrays of the output descriptor.
+  Properties without an output array are not computed.
+  @param n Number of elements
+  @param p Array of pressures
+  @param T Array of temperatures
+  @param states Output arrays
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_pT_arrays_C_impl(int n, const double *p, const double *T, const ExternalThermodynamicStateArrays *states,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesArraysParallel(mediumName, libraryName, substanceName, CHOICE_pT, n, p, T, NULL, false, *states);
+}
+
+//! Compute properties from arrays of d, T, and phase into separate arrays per property
+/*!
+  This function computes the properties for n elements with the same
+  medium and writes them to the non-NULL arrays of the output descriptor.
+  Properties without an output array are not computed.
+  @param n Number of elements
+  @param d Array of densities
+  @param T Array of temperatures
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param states Output arrays
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_dT_arrays_C_impl(int n, const double *d, const double *T, const int *phase, const ExternalThermodynamicStateArrays *states,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesArraysParallel(mediumName, libraryName, substanceName, CHOICE_dT, n, d, T, phase, false, *states);
+}
+
+//! Compute properties from arrays of p, s, and phase into separate arrays per property
+/*!
+  This function computes the properties for n elements with the same
+  medium and writes them to the non-NULL arrays of the output descriptor.
+  Properties without an output array are not computed.
+  @param n Number of elements
+  @param p Array of pressures
+  @param s Array of specific entropies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param ordered Non-zero if the elements are consecutive cells of a 1-D discretization
+  @param states Output arrays
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_ps_arrays_C_impl(int n, const double *p, const double *s, const int *phase, int ordered, const ExternalThermodynamicStateArrays *states,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesArraysParallel(mediumName, libraryName, substanceName, CHOICE_ps, n, p, s, phase, ordered != 0, *states);
+}
+
+//! Compute properties from arrays of h, s, and phase into separate arrays per property
+/*!
+  This function computes the properties for n elements with the same
+  medium and writes them to the non-NULL arrays of the output descriptor.
+  Properties without an output array are not computed.
+  @param n Number of elements
+  @param h Array of specific enthalpies
+  @param s Array of specific entropies
+  @param phase Array of phases (2 for two-phase, 1 for one-phase, 0 if not known), can be NULL
+  @param ordered Non-zero if the elements are consecutive cells of a 1-D discretization
+  @param states Output arrays
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setStates_hs_arrays_C_impl(int n, const double *h, const double *s, const int *phase, int ordered, const ExternalThermodynamicStateArrays *states,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	setStatesArraysParallel(mediumName, libraryName, substanceName, CHOICE_hs, n, h, s, phase, ordered != 0, *states);
+}
+
+//! Compute properties from p, h, and phase, together with their sensitivities to the inputs
+/*!
+  This function computes the properties for the specified inputs and the
+  partial derivatives of all the properties with respect to both inputs,
+  see BaseSolver::setState_jac.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param state Pointer to return values for ExternalThermodynamicState struct
+  @param state_dp Pointer to return the derivatives of all properties wrt p at constant h
+  @param state_dh Pointer to return the derivatives of all properties wrt h at constant p
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ph_jac_C_impl(double p, double h, int phase, ExternalThermodynamicState *state,
+									 ExternalThermodynamicState *state_dp, ExternalThermodynamicState *state_dh,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_jac(CHOICE_ph, p, h, phase, state, state_dp, state_dh);
+}
+
+//! Compute properties from p and T, together with their sensitivities to the inputs
+/*!
+  This function computes the properties for the specified inputs and the
+  partial derivatives of all the properties with respect to both inputs,
+  see BaseSolver::setState_jac.
+  @param p Pressure
+  @param T Temperature
+  @param state Pointer to return values for ExternalThermodynamicState struct
+  @param state_dp Pointer to return the derivatives of all properties wrt p at constant T
+  @param state_dT Pointer to return the derivatives of all properties wrt T at constant p
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_pT_jac_C_impl(double p, double T, ExternalThermodynamicState *state,
+									 ExternalThermodynamicState *state_dp, ExternalThermodynamicState *state_dT,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	int phase = 0;
+	solver->setState_jac(CHOICE_pT, p, T, phase, state, state_dp, state_dT);
+}
+
+//! Compute properties from d, T, and phase, together with their sensitivities to the inputs
+/*!
+  This function computes the properties for the specified inputs and the
+  partial derivatives of all the properties with respect to both inputs,
+  see BaseSolver::setState_jac.
+  @param d Density
+  @param T Temperature
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param state Pointer to return values for ExternalThermodynamicState struct
+  @param state_dd Pointer to return the derivatives of all properties wrt d at constant T
+  @param state_dT Pointer to return the derivatives of all properties wrt T at constant d
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_dT_jac_C_impl(double d, double T, int phase, ExternalThermodynamicState *state,
+									 ExternalThermodynamicState *state_dd, ExternalThermodynamicState *state_dT,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_jac(CHOICE_dT, d, T, phase, state, state_dd, state_dT);
+}
+
+//! Compute properties from p, s, and phase, together with their sensitivities to the inputs
+/*!
+  This function computes the properties for the specified inputs and the
+  partial derivatives of all the properties with respect to both inputs,
+  see BaseSolver::setState_jac.
+  @param p Pressure
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param state Pointer to return values for ExternalThermodynamicState struct
+  @param state_dp Pointer to return the derivatives of all properties wrt p at constant s
+  @param state_ds Pointer to return the derivatives of all properties wrt s at constant p
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ps_jac_C_impl(double p, double s, int phase, ExternalThermodynamicState *state,
+									 ExternalThermodynamicState *state_dp, ExternalThermodynamicState *state_ds,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_jac(CHOICE_ps, p, s, phase, state, state_dp, state_ds);
+}
+
+//! Compute properties from h, s, and phase, together with their sensitivities to the inputs
+/*!
+  This function computes the properties for the specified inputs and the
+  partial derivatives of all the properties with respect to both inputs,
+  see BaseSolver::setState_jac.
+  @param h Specific enthalpy
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param state Pointer to return values for ExternalThermodynamicState struct
+  @param state_dh Pointer to return the derivatives of all properties wrt h at constant s
+  @param state_ds Pointer to return the derivatives of all properties wrt s at constant h
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_hs_jac_C_impl(double h, double s, int phase, ExternalThermodynamicState *state,
+									 ExternalThermodynamicState *state_dh, ExternalThermodynamicState *state_ds,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_jac(CHOICE_hs, h, s, phase, state, state_dh, state_ds);
+}
+
+//! Compute properties from p, h, and phase, together with the saturation properties
+/*!
+  This function computes the properties for the specified inputs and the
+  saturation properties at the pressure of the resulting state in a single
+  call, as needed by BaseProperties.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param ExternalSaturationProperties Pointer to return values for ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ph_sat_C_impl(double p, double h, int phase, ExternalThermodynamicState *state, ExternalSaturationProperties *sat,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_ph_sat(p, h, phase, state, sat);
+	solver->storeLastState(CHOICE_ph, p, h, phase, *state);
+}
+
+//! Compute properties from p, T, together with the saturation properties
+/*!
+  This function computes the properties for the specified inputs and the
+  saturation properties at the pressure of the resulting state in a single
+  call, as needed by BaseProperties.
+  @param p Pressure
+  @param T Temperature
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param ExternalSaturationProperties Pointer to return values for ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_pT_sat_C_impl(double p, double T, ExternalThermodynamicState *state, ExternalSaturationProperties *sat,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_pT_sat(p, T, state, sat);
+	solver->storeLastState(CHOICE_pT, p, T, 0, *state);
+}
+
+//! Compute properties from d, T, and phase, together with the saturation properties
+/*!
+  This function computes the properties for the specified inputs and the
+  saturation properties at the pressure of the resulting state in a single
+  call, as needed by BaseProperties.
+  @param d Density
+  @param T Temperature
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param ExternalSaturationProperties Pointer to return values for ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_dT_sat_C_impl(double d, double T, int phase, ExternalThermodynamicState *state, ExternalSaturationProperties *sat,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_dT_sat(d, T, phase, state, sat);
+	solver->storeLastState(CHOICE_dT, d, T, phase, *state);
+}
+
+//! Compute properties from p, s, and phase, together with the saturation properties
+/*!
+  This function computes the properties for the specified inputs and the
+  saturation properties at the pressure of the resulting state in a single
+  call, as needed by BaseProperties.
+  @param p Pressure
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param ExternalSaturationProperties Pointer to return values for ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ps_sat_C_impl(double p, double s, int phase, ExternalThermodynamicState *state, ExternalSaturationProperties *sat,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_ps_sat(p, s, phase, state, sat);
+	solver->storeLastState(CHOICE_ps, p, s, phase, *state);
+}
+
+//! Compute properties from h, s, and phase, together with the saturation properties
+/*!
+  This function computes the properties for the specified inputs and the
+  saturation properties at the pressure of the resulting state in a single
+  call, as needed by BaseProperties.
+  @param h Specific enthalpy
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param ExternalSaturationProperties Pointer to return values for ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_hs_sat_C_impl(double h, double s, int phase, ExternalThermodynamicState *state, ExternalSaturationProperties *sat,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_hs_sat(h, s, phase, state, sat);
+	solver->storeLastState(CHOICE_hs, h, s, phase, *state);
+}
+
+//! Compute the time derivatives of the state record and of the saturation properties from p, h, and phase
+/*!
+  This function computes the time derivatives of the outputs of
+  TwoPhaseMedium_setState_ph_sat_C_impl for the specified inputs and input
+  derivatives, see BaseSolver::setState_sat_der.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param p_der Time derivative of pressure
+  @param h_der Time derivative of specific enthalpy
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param sat_der Pointer to return values for the time derivative of the ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ph_sat_der_C_impl(double p, double h, int phase, double p_der, double h_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der,
+										 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_sat_der(CHOICE_ph, p, h, phase, p_der, h_der, state_der, sat_der);
+}
+
+//! Compute the time derivatives of the state record and of the saturation properties from p, T, and phase
+/*!
+  This function computes the time derivatives of the outputs of
+  TwoPhaseMedium_setState_pT_sat_C_impl for the specified inputs and input
+  derivatives, see BaseSolver::setState_sat_der.
+  @param p Pressure
+  @param T Temperature
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param p_der Time derivative of pressure
+  @param T_der Time derivative of temperature
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param sat_der Pointer to return values for the time derivative of the ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_pT_sat_der_C_impl(double p, double T, int phase, double p_der, double T_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der,
+										 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_sat_der(CHOICE_pT, p, T, phase, p_der, T_der, state_der, sat_der);
+}
+
+//! Compute the time derivatives of the state record and of the saturation properties from d, T, and phase
+/*!
+  This function computes the time derivatives of the outputs of
+  TwoPhaseMedium_setState_dT_sat_C_impl for the specified inputs and input
+  derivatives, see BaseSolver::setState_sat_der.
+  @param d Density
+  @param T Temperature
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param d_der Time derivative of density
+  @param T_der Time derivative of temperature
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param sat_der Pointer to return values for the time derivative of the ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_dT_sat_der_C_impl(double d, double T, int phase, double d_der, double T_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der,
+										 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_sat_der(CHOICE_dT, d, T, phase, d_der, T_der, state_der, sat_der);
+}
+
+//! Compute the time derivatives of the state record and of the saturation properties from p, s, and phase
+/*!
+  This function computes the time derivatives of the outputs of
+  TwoPhaseMedium_setState_ps_sat_C_impl for the specified inputs and input
+  derivatives, see BaseSolver::setState_sat_der.
+  @param p Pressure
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param p_der Time derivative of pressure
+  @param s_der Time derivative of specific entropy
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param sat_der Pointer to return values for the time derivative of the ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ps_sat_der_C_impl(double p, double s, int phase, double p_der, double s_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der,
+										 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_sat_der(CHOICE_ps, p, s, phase, p_der, s_der, state_der, sat_der);
+}
+
+//! Compute the time derivatives of the state record and of the saturation properties from h, s, and phase
+/*!
+  This function computes the time derivatives of the outputs of
+  TwoPhaseMedium_setState_hs_sat_C_impl for the specified inputs and input
+  derivatives, see BaseSolver::setState_sat_der.
+  @param h Specific enthalpy
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param h_der Time derivative of specific enthalpy
+  @param s_der Time derivative of specific entropy
+  @param state_der Pointer to return values for the time derivative of the ExternalThermodynamicState struct
+  @param sat_der Pointer to return values for the time derivative of the ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_hs_sat_der_C_impl(double h, double s, int phase, double h_der, double s_der, ExternalThermodynamicState *state_der, ExternalSaturationProperties *sat_der,
+										 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setState_sat_der(CHOICE_hs, h, s, phase, h_der, s_der, state_der, sat_der);
+}
+
+//! Compute selected properties from p, h, and phase
+/*!
+  This function computes the properties for the specified inputs. Only the
+  properties selected by the mask are guaranteed to be computed, the others
+  are set to NAN.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param mask Combination of the PROPERTY_xx flags, see externalmedialib.h
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ph_mask_C_impl(double p, double h, int phase, int mask, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setPropertyMask(mask);
+	solver->setState_ph(p, h, phase, state);
+	BaseSolver::applyPropertyMask(mask, state);
+}
+
+//! Compute selected properties from p, T
+/*!
+  This function computes the properties for the specified inputs. Only the
+  properties selected by the mask are guaranteed to be computed, the others
+  are set to NAN.
+  @param p Pressure
+  @param T Temperature
+  @param mask Combination of the PROPERTY_xx flags, see externalmedialib.h
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_pT_mask_C_impl(double p, double T, int mask, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setPropertyMask(mask);
+	solver->setState_pT(p, T, state);
+	BaseSolver::applyPropertyMask(mask, state);
+}
+
+//! Compute selected properties from d, T, and phase
+/*!
+  This function computes the properties for the specified inputs. Only the
+  properties selected by the mask are guaranteed to be computed, the others
+  are set to NAN.
+  @param d Density
+  @param T Temperature
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param mask Combination of the PROPERTY_xx flags, see externalmedialib.h
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_dT_mask_C_impl(double d, double T, int phase, int mask, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setPropertyMask(mask);
+	solver->setState_dT(d, T, phase, state);
+	BaseSolver::applyPropertyMask(mask, state);
+}
+
+//! Compute selected properties from p, s, and phase
+/*!
+  This function computes the properties for the specified inputs. Only the
+  properties selected by the mask are guaranteed to be computed, the others
+  are set to NAN.
+  @param p Pressure
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param mask Combination of the PROPERTY_xx flags, see externalmedialib.h
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ps_mask_C_impl(double p, double s, int phase, int mask, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setPropertyMask(mask);
+	solver->setState_ps(p, s, phase, state);
+	BaseSolver::applyPropertyMask(mask, state);
+}
+
+//! Compute selected properties from h, s, and phase
+/*!
+  This function computes the properties for the specified inputs. Only the
+  properties selected by the mask are guaranteed to be computed, the others
+  are set to NAN.
+  @param h Specific enthalpy
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param mask Combination of the PROPERTY_xx flags, see externalmedialib.h
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_hs_mask_C_impl(double h, double s, int phase, int mask, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setPropertyMask(mask);
+	solver->setState_hs(h, s, phase, state);
+	BaseSolver::applyPropertyMask(mask, state);
+}
+
+//! Compute properties from p, h, and phase, warm starting from a caller-defined slot
+/*!
+  This function computes the properties for the specified inputs. The
+  flash is started from the last solution obtained by the calling thread
+  in the same slot, if that solution is close enough to the new inputs.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param slot Caller-defined slot id, e.g. the index of a control volume
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ph_slot_C_impl(double p, double h, int phase, int slot, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setFlashSlot(slot);
+    solver->setState_ph(p, h, phase, state);
+}
+
+//! Compute properties from p, s, and phase, warm starting from a caller-defined slot
+/*!
+  This function computes the properties for the specified inputs.
+  @param p Pressure
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param slot Caller-defined slot id, e.g. the index of a control volume
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_ps_slot_C_impl(double p, double s, int phase, int slot, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setFlashSlot(slot);
+    solver->setState_ps(p, s, phase, state);
+}
+
+//! Compute properties from h, s, and phase, warm starting from a caller-defined slot
+/*!
+  This function computes the properties for the specified inputs.
+  @param h Specific enthalpy
+  @param s Specific entropy
+  @param phase Phase (2 for two-phase, 1 for one-phase, 0 if not known)
+  @param slot Caller-defined slot id, e.g. the index of a control volume
+  @param ExternalThermodynamicState Pointer to return values for ExternalThermodynamicState struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setState_hs_slot_C_impl(double h, double s, int phase, int slot, ExternalThermodynamicState *state,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solver->setFlashSlot(slot);
+    solver->setState_hs(h, s, phase, state);
+}
+
+//! Return flash statistics
+/*!
+  This function returns the number of flashes of the specified medium
+  that were started cold and warm, respectively, including those of the
+  worker threads of the batched calls. Both are zero if the medium has
+  not been used in the current context.
+  @param coldFlashes Number of flashes started without initial guess
+  @param warmFlashes Number of flashes started from a previous solution
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_getFlashStatistics_C_impl(long *coldFlashes, long *warmFlashes,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	SolverStatistics statistics = SolverMap::current()->statistics(libraryName, substanceName);
+	*coldFlashes = statistics.coldFlashes;
+	*warmFlashes = statistics.warmFlashes;
+}
+
+//! Return look-up table statistics
+/*!
+  This function returns the number of state updates of the specified
+  medium computed from look-up tables and from the equation of state,
+  respectively. With the CoolProp option background_tables=1 the states
+  are computed from the equation of state until the tables are built.
+  Only solvers with look-up tables enabled count their state updates. The
+  state updates of the worker threads of the batched calls are included.
+  @param tableEvaluations Number of state updates computed from look-up tables
+  @param exactEvaluations Number of state updates computed from the equation of state
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_getTableStatistics_C_impl(long *tableEvaluations, long *exactEvaluations,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	SolverStatistics statistics = SolverMap::current()->statistics(libraryName, substanceName);
+	*tableEvaluations = statistics.tableEvaluations;
+	*exactEvaluations = statistics.exactEvaluations;
+}
+
+//! Return tile occupancy statistics
+/*!
+  This function returns the number of tiles of the table filled on first
+  access (CoolProp option enable_tiles=1) computed so far for the
+  specified medium, and the number of p-h states interpolated from the
+  table and left to the equation of state, respectively. All are zero if
+  the medium has no such table.
+  @param tiles Number of computed tiles
+  @param hits Number of states interpolated from the table
+  @param misses Number of states computed by the equation of state
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_getTileStatistics_C_impl(long *tiles, long *hits, long *misses,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	TiledTable *table = SolverMap::getSolver(mediumName, libraryName, substanceName)->tiledTable();
+	if (table == NULL){
+		*tiles = *hits = *misses = 0;
+		return;
+	}
+	TiledTableStatistics statistics = table->statistics();
+	*tiles = statistics.tiles;
+	*hits = statistics.hits;
+	*misses = statistics.misses;
+}
+
+//! Write a report of the tiles used by a medium
+/*!
+  The report lists the pressure and enthalpy range of each computed tile
+  of the table filled on first access with the number of states
+  interpolated in it, see TwoPhaseMedium_getTileStatistics_C_impl. It is
+  truncated to the size of the buffer.
+  @param report Buffer for the report
+  @param size Size of the buffer
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+  @return Length of the full report
+*/
+int TwoPhaseMedium_getTileReport_C_impl(char *report, int size,
+									 const char *mediumName, const char *libraryName, const char *substanceName){
+	TiledTable *table = SolverMap::getSolver(mediumName, libraryName, substanceName)->tiledTable();
+	string text(table != NULL ? table->report() : string());
+	if (size > 0){
+		strncpy(report, text.c_str(), size - 1);
+		report[size - 1] = '\0';
+	}
+	return (int)text.size();
 }
 
 //! Compute partial derivative from a populated state record
@@ -159,6 +1352,35 @@ double TwoPhaseMedium_partialDeriv_state_C_impl(const char *of, const char *wrt,
     return solver->partialDeriv_state(of, wrt, cst, state);
 }
 
+//! Compile a partial derivative id
+/*!
+  This function converts the strings defining a partial derivative into an
+  integer id, to be computed once and then passed to
+  TwoPhaseMedium_partialDeriv_state_id_C_impl. The id does not depend on the medium.
+  @param of Property to differentiate (p, T, d, h, s or u)
+  @param wrt Property to differentiate in (p, T, d, h, s or u)
+  @param cst Property to remain constant (p, T, d, h, s or u)
+*/
+int TwoPhaseMedium_partialDeriv_id_C_impl(const char *of, const char *wrt, const char *cst){
+	return BaseSolver::partialDeriv_id(of, wrt, cst);
+}
+
+//! Compute partial derivative from a populated state record and a derivative id
+/*!
+  This function computes the derivative with the specified id. For one-phase
+  states, it only takes a few operations on the state record.
+  @param id Derivative id returned by TwoPhaseMedium_partialDeriv_id_C_impl
+  @param state Pointer to input values in state record
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+double TwoPhaseMedium_partialDeriv_state_id_C_impl(int id, ExternalThermodynamicState *state,
+		const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+    return solver->partialDeriv_state_id(id, state);
+}
+
 
 //! Return Prandtl number of specified medium
 /*! Note: This function is not used by the default implementation of ExternalTwoPhaseMedium class.
@@ -320,6 +1542,24 @@ double TwoPhaseMedium_density_ph_der_C_impl(ExternalThermodynamicState *state,
     return solver->d_der(state);
 }
 
+//! Return total derivative of density pT of specified medium
+/*!
+  This function computes the derivative from the isothermal compressibility
+  and the isobaric expansion coefficient of the state, without a new state
+  computation.
+  @param state Pointer to input values in state record
+  @param p_der Time derivative of pressure
+  @param T_der Time derivative of temperature
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+double TwoPhaseMedium_density_pT_der_C_impl(ExternalThermodynamicState *state, double p_der, double T_der,
+									  const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+    return solver->d_der_pT(state, p_der, T_der);
+}
+
 //! Return the enthalpy at pressure p after an isentropic transformation from the specified medium state
 double TwoPhaseMedium_isentropicEnthalpy_C_impl(double p_downstream, ExternalThermodynamicState *refState,
 										  const char *mediumName, const char *libraryName, const char *substanceName){
@@ -357,6 +1597,73 @@ void TwoPhaseMedium_setSat_T_C_impl(double T, ExternalSaturationProperties *sat,
     solver->setSat_T(T, sat);
 }
 
+//! Compute saturation properties from an array of p
+/*!
+  This function computes the saturation properties for n pressures with
+  the same medium. The solver is looked up once for the whole batch, and
+  large batches are evaluated in parallel (see parallelbatch.h).
+  @param n Number of elements
+  @param p Array of pressures
+  @param sat Array of n ExternalSaturationProperties structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setSats_p_C_impl(int n, const double *p, ExternalSaturationProperties *sat,
+							  const char *mediumName, const char *libraryName, const char *substanceName){
+	setSatsParallel(mediumName, libraryName, substanceName, true, n, p, sat);
+}
+
+//! Compute saturation properties from an array of T
+/*!
+  This function computes the saturation properties for n temperatures with
+  the same medium. The solver is looked up once for the whole batch, and
+  large batches are evaluated in parallel (see parallelbatch.h).
+  @param n Number of elements
+  @param T Array of temperatures
+  @param sat Array of n ExternalSaturationProperties structs for the return values
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setSats_T_C_impl(int n, const double *T, ExternalSaturationProperties *sat,
+							  const char *mediumName, const char *libraryName, const char *substanceName){
+	setSatsParallel(mediumName, libraryName, substanceName, false, n, T, sat);
+}
+
+//! Compute saturation properties from the pressure of a state
+/*!
+  This function computes the saturation properties at the pressure of the
+  specified state. Records recently computed at the same pressure are reused.
+  @param state Pointer to input values in state record
+  @param ExternalSaturationProperties Pointer to return values for ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setSat_p_state_C_impl(ExternalThermodynamicState *state, ExternalSaturationProperties *sat,
+							  const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+    solver->setSat_p_state(state, sat);
+}
+
+//! Compute saturation properties from the temperature of a state
+/*!
+  This function computes the saturation properties at the temperature of the
+  specified state. Records recently computed at the same temperature, or at
+  the same pressure for two-phase states, are reused.
+  @param state Pointer to input values in state record
+  @param ExternalSaturationProperties Pointer to return values for ExternalSaturationProperties struct
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+void TwoPhaseMedium_setSat_T_state_C_impl(ExternalThermodynamicState *state, ExternalSaturationProperties *sat,
+							  const char *mediumName, const char *libraryName, const char *substanceName){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+    solver->setSat_T_state(state, sat);
+}
+
 //! Compute bubble state
 /*!
   This function computes the  bubble state for the specified medium.
@@ -0,0 +1,169 @@
+/* *****************************************************************
+ * Implementation of the persistent cache of fluid data
+ ********************************************************************/
+
+#include "fluidcache.h"
+#include "threading.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <vector>
+
+//! Header line of the cache files, changed when the format changes
+static const char *cacheHeader = "ExternalMedia fluid cache 1";
+
+//! Fields of the saturation properties record, in the order they are stored
+static double ExternalSaturationProperties::*const saturationFields[] = {
+	&ExternalSaturationProperties::Tsat, &ExternalSaturationProperties::dTp,
+	&ExternalSaturationProperties::ddldp, &ExternalSaturationProperties::ddvdp,
+	&ExternalSaturationProperties::dhldp, &ExternalSaturationProperties::dhvdp,
+	&ExternalSaturationProperties::dl, &ExternalSaturationProperties::dv,
+	&ExternalSaturationProperties::hl, &ExternalSaturationProperties::hv,
+	&ExternalSaturationProperties::psat, &ExternalSaturationProperties::sigma,
+	&ExternalSaturationProperties::sl, &ExternalSaturationProperties::sv
+};
+static const int saturationFieldCount = sizeof(saturationFields)/sizeof(saturationFields[0]);
+
+static Mutex directoryMutex;
+static bool directoryInitialised = false;
+static string cacheDirectory;
+
+//! Set the cache directory
+/*!
+  @param directory Existing directory for the cache files, empty to disable the cache
+*/
+void FluidCache::setDirectory(const string &directory){
+	ScopedLock lock(directoryMutex);
+	cacheDirectory = directory;
+	directoryInitialised = true;
+}
+
+//! Return the cache directory, empty if the cache is disabled
+string FluidCache::directory(){
+	ScopedLock lock(directoryMutex);
+	if (!directoryInitialised){
+		const char *environment = getenv("EXTERNALMEDIA_CACHE_DIR");
+		cacheDirectory = environment ? environment : "";
+		directoryInitialised = true;
+	}
+	return cacheDirectory;
+}
+
+//! Return the file name of a cache entry, empty if the cache is disabled
+string FluidCache::fileName(const string &key){
+	string path(directory());
+	if (path.empty())
+		return path;
+	// 32 bit FNV-1a hash; the key stored in the file resolves collisions
+	unsigned long hash = 2166136261UL;
+	for (unsigned int i = 0; i < key.size(); i++)
+		hash = ((hash ^ (unsigned char)key[i])*16777619UL) & 0xffffffffUL;
+	char name[20];
+	sprintf(name, "%08lx.cache", hash);
+	char last = path[path.size() - 1];
+	if (last != '/' && last != '\\')
+		path += "/";
+	return path + name;
+}
+
+//! Load values from the cache
+/*!
+  Returns true if an entry with the given key and number of values exists.
+  @param key Key of the entry
+  @param n Number of values
+  @param values Array of n values to be filled
+*/
+bool FluidCache::load(const string &key, int n, double *values){
+	string name(fileName(key));
+	if (name.empty())
+		return false;
+	FILE *file = fopen(name.c_str(), "r");
+	if (file == NULL)
+		return false;
+
+	bool found = true;
+	string line;
+	// Compare the header and the key line by line
+	for (int i = 0; i < 2 && found; i++){
+		line.clear();
+		int c;
+		while ((c = fgetc(file)) != EOF && c != '\n')
+			line += (char)c;
+		found = (line == (i == 0 ? string(cacheHeader) : key));
+	}
+	int count = 0;
+	found = found && fscanf(file, "%d", &count) == 1 && count == n;
+	std::vector<double> read(n);
+	for (int i = 0; i < n && found; i++)
+		found = fscanf(file, "%lf", &read[i]) == 1;
+	fclose(file);
+
+	if (found)
+		for (int i = 0; i < n; i++)
+			values[i] = read[i];
+	return found;
+}
+
+//! Store values in the cache
+/*!
+  The entry is written to a temporary file first and then renamed, so that
+  other processes never read a partial entry. Entries with values that are
+  not finite are not stored.
+  @param key Key of the entry
+  @param n Number of values
+  @param values Array of n values
+*/
+void FluidCache::store(const string &key, int n, const double *values){
+	string name(fileName(key));
+	if (name.empty())
+		return;
+	for (int i = 0; i < n; i++)
+		if (!(values[i] >= -DBL_MAX && values[i] <= DBL_MAX))
+			return;
+
+	// Thread identifiers are only unique within a process
+	char suffix[60];
+	sprintf(suffix, ".%lu.%lu.tmp", currentProcessId(), currentThreadId());
+	string temporary(name + suffix);
+	FILE *file = fopen(temporary.c_str(), "w");
+	if (file == NULL)
+		return;
+	bool written = fprintf(file, "%s\n%s\n%d\n", cacheHeader, key.c_str(), n) > 0;
+	for (int i = 0; i < n && written; i++)
+		written = fprintf(file, "%.17g\n", values[i]) > 0;
+	written = (fclose(file) == 0) && written;
+
+	// Rename does not replace existing files on all platforms
+	if (written && rename(temporary.c_str(), name.c_str()) != 0){
+		remove(name.c_str());
+		written = rename(temporary.c_str(), name.c_str()) == 0;
+	}
+	if (!written)
+		remove(temporary.c_str());
+}
+
+//! Load a saturation properties record from the cache
+/*!
+  @param key Key of the entry
+  @param properties ExternalSaturationProperties property struct to be filled
+*/
+bool FluidCache::loadSaturation(const string &key, ExternalSaturationProperties *const properties){
+	double values[saturationFieldCount];
+	if (!load(key, saturationFieldCount, values))
+		return false;
+	for (int i = 0; i < saturationFieldCount; i++)
+		properties->*saturationFields[i] = values[i];
+	return true;
+}
+
+//! Store a saturation properties record in the cache
+/*!
+  @param key Key of the entry
+  @param properties ExternalSaturationProperties property struct
+*/
+void FluidCache::storeSaturation(const string &key, const ExternalSaturationProperties &properties){
+	double values[saturationFieldCount];
+	for (int i = 0; i < saturationFieldCount; i++)
+		values[i] = properties.*saturationFields[i];
+	store(key, saturationFieldCount, values);
+}
@@ -0,0 +1,39 @@
+/*!
+  \file fluidcache.h
+  \brief Persistent cache of fluid data
+
+  Fluid constants and other data that only depend on the backend, its
+  version and the fluid are stored on disk, so that the next processes
+  using the same fluid skip their computation, e.g. the iterations close
+  to the critical point.
+
+  Each entry is a file named after a hash of its key, holding the full
+  key and the values in text form. The key must identify the backend
+  version, the fluid with all its options and the kind of data. The cache
+  is disabled unless a directory is set with the environment variable
+  EXTERNALMEDIA_CACHE_DIR or with setDirectory(); errors reading or
+  writing the files are ignored and the data is then computed as usual.
+*/
+
+#ifndef FLUIDCACHE_H_
+#define FLUIDCACHE_H_
+
+#include "include.h"
+#include "externalmedialib.h"
+
+//! Persistent cache of fluid data
+class FluidCache{
+public:
+	static void setDirectory(const string &directory);
+	static string directory();
+
+	static bool load(const string &key, int n, double *values);
+	static void store(const string &key, int n, const double *values);
+	static bool loadSaturation(const string &key, ExternalSaturationProperties *const properties);
+	static void storeSaturation(const string &key, const ExternalSaturationProperties &properties);
+
+private:
+	static string fileName(const string &key);
+};
+
+#endif // FLUIDCACHE_H_
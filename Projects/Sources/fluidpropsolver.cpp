@@ -11,15 +11,10 @@
 
 #define _AFXDLL
 
-ExternalSaturationProperties satPropClose2Crit; // saturation properties close to  critical conditions
-double p_eps; // relative tolerance margin for subcritical pressure conditions
-double T_eps; // relative tolerance margin for supercritical temperature conditions
-double delta_h = 1e-2; // delta_h for one-phase/two-phase discrimination
-
 FluidPropSolver::FluidPropSolver(const string &mediumName,
 								 const string &libraryName,
 								 const string &substanceName)
-	: BaseSolver(mediumName, libraryName, substanceName){
+	: BaseSolver(mediumName, libraryName, substanceName), _criticalBand(NULL){
 
 	string ErrorMsg;
 	string Comp[20];
@@ -47,11 +42,21 @@ FluidPropSolver::FluidPropSolver(const string &mediumName,
 		errorMessage(error);
 	}
 
-	// Set fluid constants
-	setFluidConstants();
+	// The fluid constants are computed on first need, see initFluidConstants
 }
 
 FluidPropSolver::~FluidPropSolver(){
+	CriticalBand::release(_criticalBand);
+}
+
+//! Estimate the memory used by the solver in bytes
+/*!
+  The memory of the FluidProp COM server is not included; the share of
+  the critical band is, see CriticalBand::memoryShare.
+*/
+size_t FluidPropSolver::memoryUsage(){
+	return BaseSolver::memoryUsage() + sizeof(FluidPropSolver) - sizeof(BaseSolver) +
+		(_criticalBand != NULL ? _criticalBand->memoryShare() : 0);
 }
 
 void FluidPropSolver::setFluidConstants(){
@@ -82,17 +87,17 @@ void FluidPropSolver::setFluidConstants(){
   }
 
   // Computation of critical density with slightly supercritical temperature to avoid convergence problems
-  // T_eps is kept as a static variable
-  for(T_eps = 1e-5;; T_eps *= 3)
+  // _T_eps is kept as a member variable
+  for(_T_eps = 1e-5;; _T_eps *= 3)
   {
-	if (T_eps > 1e-3) {
+	if (_T_eps > 1e-3) {
 	  // Superheating is too large:
 	  // Build error message and pass it to the Modelica environment
 	  char error[300];
 	  sprintf(error, "FluidProp error in FluidPropSolver::setFluidConstants: can't compute critical density\n %s\n", ErrorMsg.c_str());
 	  errorMessage(error);
 	}
-    _fluidConstants.dc = FluidProp.Density("PT", _fluidConstants.pc, _fluidConstants.Tc*(1.0 + T_eps), &ErrorMsg);
+    _fluidConstants.dc = FluidProp.Density("PT", _fluidConstants.pc, _fluidConstants.Tc*(1.0 + _T_eps), &ErrorMsg);
     if (!isError(ErrorMsg))  // computation succeeded
 		break;
   }
@@ -106,19 +111,19 @@ void FluidPropSolver::setFluidConstants(){
   int    failed = false;
 
   // Computation of limit saturation properties at slightly subcritical pressure
-  // p_eps is kept as a static variable
-  for(p_eps = 1e-5;; p_eps *= 2)
+  // _p_eps is kept as a member variable
+  for(_p_eps = 1e-5;; _p_eps *= 2)
   {
-	if (p_eps > 2e-2) {
+	if (_p_eps > 2e-2) {
       // subcritical pressure limit too low:
       // Build error message and pass it to the Modelica environment
 	  char error[300];
 	  sprintf(error, "FluidProp error in FluidPropSolver::setFluidConstants:\nCannot compute saturation conditions at p = p_crit*(1 - %f)\n",
-		      p_eps);
+		      _p_eps);
 	  errorMessage(error);
 	}
-	// Compute saturation properties at pc*(1-p_eps)
-	FluidProp.AllPropsSat("Pq", _fluidConstants.pc*(1-p_eps) , 0.0, P_, T_, v_, d_, h_, s_, u_, q_, x_, y_, cv_, cp_, c_,
+	// Compute saturation properties at pc*(1-_p_eps)
+	FluidProp.AllPropsSat("Pq", _fluidConstants.pc*(1-_p_eps) , 0.0, P_, T_, v_, d_, h_, s_, u_, q_, x_, y_, cv_, cp_, c_,
 						  alpha_, beta_, chi_, fi_, ksi_, psi_, zeta_, theta_, kappa_, gamma_, eta_, lambda_,
 						  d_liq_, d_vap_, h_liq_, h_vap_, T_sat_, dd_liq_dP_, dd_vap_dP_, dh_liq_dP_,
 						  dh_vap_dP_, dT_sat_dP_, &ErrorMsg);
@@ -130,21 +135,114 @@ void FluidPropSolver::setFluidConstants(){
     	errorMessage(error); // a license error has been generated
     }
   }
-  // Fill in the satPropClose2Crit record
-  satPropClose2Crit.Tsat = T_sat_;		// saturation temperature
-  satPropClose2Crit.dTp = dT_sat_dP_;  // derivative of Ts by pressure
-  satPropClose2Crit.ddldp = dd_liq_dP_; // derivative of dls by pressure
-  satPropClose2Crit.ddvdp = dd_vap_dP_; // derivative of dvs by pressure
-  satPropClose2Crit.dhldp = dh_liq_dP_; // derivative of hls by pressure
-  satPropClose2Crit.dhvdp = dh_vap_dP_; // derivative of hvs by pressure
-  satPropClose2Crit.dl = d_liq_;	// bubble density
-  satPropClose2Crit.dv = d_vap_;	// dew density
-  satPropClose2Crit.hl = h_liq_;	// bubble specific enthalpy
-  satPropClose2Crit.hv = h_vap_;	// dew specific enthalpy
-  satPropClose2Crit.psat = _fluidConstants.pc*(1-p_eps);     // saturation pressure
+  // Fill in the _satPropClose2Crit record
+  _satPropClose2Crit.Tsat = T_sat_;		// saturation temperature
+  _satPropClose2Crit.dTp = dT_sat_dP_;  // derivative of Ts by pressure
+  _satPropClose2Crit.ddldp = dd_liq_dP_; // derivative of dls by pressure
+  _satPropClose2Crit.ddvdp = dd_vap_dP_; // derivative of dvs by pressure
+  _satPropClose2Crit.dhldp = dh_liq_dP_; // derivative of hls by pressure
+  _satPropClose2Crit.dhvdp = dh_vap_dP_; // derivative of hvs by pressure
+  _satPropClose2Crit.dl = d_liq_;	// bubble density
+  _satPropClose2Crit.dv = d_vap_;	// dew density
+  _satPropClose2Crit.hl = h_liq_;	// bubble specific enthalpy
+  _satPropClose2Crit.hv = h_vap_;	// dew specific enthalpy
+  _satPropClose2Crit.psat = _fluidConstants.pc*(1-_p_eps);     // saturation pressure
   }
 
+//! Return the tables around the critical point, NULL if disabled
+/*!
+  Threads racing on the first call each take a reference to the band;
+  only the first one is kept.
+*/
+CriticalBand *FluidPropSolver::criticalBand(){
+	if (!_criticalBandOnce.done()){
+		initFluidConstants();
+		CriticalBand *band = CriticalBand::shared(libraryName + "|" + substanceName, _fluidConstants.pc);
+		ScopedLock lock(_criticalBandMutex);
+		if (_criticalBandOnce.done())
+			CriticalBand::release(band);
+		else {
+			_criticalBand = band;
+			_criticalBandOnce.setDone();
+		}
+	}
+	return _criticalBand;
+}
+
+//! Compute the saturation properties of a node of the critical band, without reporting errors
+bool FluidPropSolver::bandSaturation(double p, ExternalSaturationProperties *const properties){
+	string ErrorMsg;
+	// FluidProp variables (in SI units)
+    double P_, T_, v_, d_, h_, s_, u_, q_, x_[20], y_[20],
+		   cv_, cp_, c_, alpha_, beta_, chi_, fi_, ksi_,
+		   psi_, zeta_, theta_, kappa_, gamma_, eta_, lambda_,
+		   d_liq_, d_vap_, h_liq_, h_vap_, T_sat_, dd_liq_dP_, dd_vap_dP_, dh_liq_dP_,
+		   dh_vap_dP_, dT_sat_dP_;
+
+	FluidProp.AllPropsSat("Pq", p , 0.0, P_, T_, v_, d_, h_, s_, u_, q_, x_, y_, cv_, cp_, c_,
+						   alpha_, beta_, chi_, fi_, ksi_, psi_, zeta_, theta_, kappa_, gamma_, eta_, lambda_,
+						   d_liq_, d_vap_, h_liq_, h_vap_, T_sat_, dd_liq_dP_, dd_vap_dP_, dh_liq_dP_,
+						   dh_vap_dP_, dT_sat_dP_, &ErrorMsg);
+	if (isError(ErrorMsg))
+		return false;
+	properties->Tsat = T_sat_;
+	properties->dTp = dT_sat_dP_;
+	properties->ddldp = dd_liq_dP_;
+	properties->ddvdp = dd_vap_dP_;
+	properties->dhldp = dh_liq_dP_;
+	properties->dhvdp = dh_vap_dP_;
+	properties->dl = d_liq_;
+	properties->dv = d_vap_;
+	properties->hl = h_liq_;
+	properties->hv = h_vap_;
+	properties->psat = p;
+	properties->sigma = NAN;
+	properties->sl = NAN;
+	properties->sv = NAN;
+	return true;
+}
+
+//! Compute a node of the p-h state table of the critical band, without reporting errors
+/*!
+  Two-phase nodes are not interpolated; one-phase nodes are split at the
+  critical density, see CoolPropSolver::tableNode.
+*/
+int FluidPropSolver::tableNode(double p, double h, ExternalThermodynamicState *const properties){
+	string ErrorMsg;
+	// FluidProp variables (in SI units)
+    double P_, T_, v_, d_, h_, s_, u_, q_, x_[20], y_[20],
+		   cv_, cp_, c_, alpha_, beta_, chi_, fi_, ksi_,
+		   psi_, zeta_ , theta_, kappa_, gamma_, eta_, lambda_;
+
+	FluidProp.AllProps("Ph", p , h, P_, T_, v_, d_, h_, s_, u_, q_, x_, y_, cv_, cp_, c_,
+		                 alpha_, beta_, chi_, fi_, ksi_, psi_,
+						 zeta_, theta_, kappa_, gamma_, eta_, lambda_, &ErrorMsg);
+	if (isError(ErrorMsg) || (q_ > 0 && q_ < 1))
+		return 0;
+	properties->T = T_;
+	properties->a = c_;
+	properties->beta = theta_;
+	properties->cp = cp_;
+	properties->cv = cv_;
+	properties->d = d_;
+	properties->ddhp = ksi_;
+	properties->ddph = psi_;
+	properties->eta = eta_;
+	properties->h = h;
+	properties->kappa = kappa_;
+	properties->lambda = lambda_;
+	properties->p = p;
+	properties->s = s_;
+	properties->phase = 1;
+	return d_ > _fluidConstants.dc ? 1 : 2;
+}
+
 void FluidPropSolver::setSat_p(double &p, ExternalSaturationProperties *const properties){
+	initFluidConstants();
+	// Pressures close to the critical one are interpolated in the critical band if enabled
+	CriticalBand *band = criticalBand();
+	if (band != NULL && band->setSat_p(p, *this, properties))
+		return;
 	string ErrorMsg;
 	// FluidProp variables (in SI units)
     double P_, T_, v_, d_, h_, s_, u_, q_, x_[20], y_[20],
@@ -154,7 +252,7 @@ void FluidPropSolver::setSat_p(double &p, ExternalSaturationProperties *const pr
 		   dh_vap_dP_, dT_sat_dP_;
 
 	// Compute all FluidProp variables at pressure p and steam quality 0
-	if (p < _fluidConstants.pc*(1-p_eps))  // subcritical conditions
+	if (p < _fluidConstants.pc*(1-_p_eps))  // subcritical conditions
 	{
 		FluidProp.AllPropsSat("Pq", p , 0.0, P_, T_, v_, d_, h_, s_, u_, q_, x_, y_, cv_, cp_, c_,
 							   alpha_, beta_, chi_, fi_, ksi_, psi_, zeta_, theta_, kappa_, gamma_, eta_, lambda_,
@@ -178,24 +276,32 @@ void FluidPropSolver::setSat_p(double &p, ExternalSaturationProperties *const pr
 		properties->hl = h_liq_;	// bubble specific enthalpy
 		properties->hv = h_vap_;	// dew specific enthalpy
 		properties->psat = p;             // saturation pressure
+
+		// Keep the saturated liquid state for setBubbleState
+		storeSaturatedState(properties, true, saturatedState(P_, T_, d_, h_, s_, cv_, cp_, c_, theta_, kappa_, eta_, lambda_));
 	}
 	else  // supercritical conditions, return slightly subcritical conditions for continuity
 	{
-		properties->Tsat = satPropClose2Crit.Tsat;		// saturation temperature
-		properties->dTp = satPropClose2Crit.dTp;  // derivative of Ts by pressure
-		properties->ddldp = satPropClose2Crit.ddldp; // derivative of dls by pressure
-		properties->ddvdp = satPropClose2Crit.ddvdp; // derivative of dvs by pressure
-		properties->dhldp = satPropClose2Crit.dhldp; // derivative of hls by pressure
-		properties->dhvdp = satPropClose2Crit.dhvdp; // derivative of hvs by pressure
-		properties->dl = satPropClose2Crit.dl;	// bubble density
-		properties->dv = satPropClose2Crit.dv;	// dew density
-		properties->hl = satPropClose2Crit.hl;	// bubble specific enthalpy
-		properties->hv = satPropClose2Crit.hv;	// dew specific enthalpy
-		properties->psat = satPropClose2Crit.psat;             // saturation pressure
+		properties->Tsat = _satPropClose2Crit.Tsat;		// saturation temperature
+		properties->dTp = _satPropClose2Crit.dTp;  // derivative of Ts by pressure
+		properties->ddldp = _satPropClose2Crit.ddldp; // derivative of dls by pressure
+		properties->ddvdp = _satPropClose2Crit.ddvdp; // derivative of dvs by pressure
+		properties->dhldp = _satPropClose2Crit.dhldp; // derivative of hls by pressure
+		properties->dhvdp = _satPropClose2Crit.dhvdp; // derivative of hvs by pressure
+		properties->dl = _satPropClose2Crit.dl;	// bubble density
+		properties->dv = _satPropClose2Crit.dv;	// dew density
+		properties->hl = _satPropClose2Crit.hl;	// bubble specific enthalpy
+		properties->hv = _satPropClose2Crit.hv;	// dew specific enthalpy
+		properties->psat = _satPropClose2Crit.psat;             // saturation pressure
 	}
 }
 
 void FluidPropSolver::setSat_T(double &T, ExternalSaturationProperties *const properties){
+	initFluidConstants();
+	// Temperatures close to the critical one are interpolated in the critical band if enabled
+	CriticalBand *band = criticalBand();
+	if (band != NULL && band->setSat_T(T, *this, properties))
+		return;
 	string ErrorMsg;
 	// FluidProp variables (in SI units)
     double P_, T_, v_, d_, h_, s_, u_, q_, x_[20], y_[20],
@@ -204,7 +310,7 @@ void FluidPropSolver::setSat_T(double &T, ExternalSaturationProperties *const pr
 		   d_liq_, d_vap_, h_liq_, h_vap_, T_sat_, dd_liq_dP_, dd_vap_dP_, dh_liq_dP_,
 		   dh_vap_dP_, dT_sat_dP_;
 
-	if (T < satPropClose2Crit.Tsat)  // subcritical conditions
+	if (T < _satPropClose2Crit.Tsat)  // subcritical conditions
 	{
 	  // Compute all FluidProp variables at temperature T and steam quality 0
 	  FluidProp.AllPropsSat("Tq", T , 0.0, P_, T_, v_, d_, h_, s_, u_, q_, x_, y_, cv_, cp_, c_,
@@ -229,20 +335,23 @@ void FluidPropSolver::setSat_T(double &T, ExternalSaturationProperties *const pr
 	  properties->hl = h_liq_;	// bubble specific enthalpy
 	  properties->hv = h_vap_;	// dew specific enthalpy
       properties->psat = P_;        // saturation pressure
+
+	  // Keep the saturated liquid state for setBubbleState
+	  storeSaturatedState(properties, true, saturatedState(P_, T_, d_, h_, s_, cv_, cp_, c_, theta_, kappa_, eta_, lambda_));
 	}
 	else  // supercritical conditions, return slightly subcritical conditions for continuity
 	{
-		properties->Tsat = satPropClose2Crit.Tsat;		// saturation temperature
-		properties->dTp = satPropClose2Crit.dTp;  // derivative of Ts by pressure
-		properties->ddldp = satPropClose2Crit.ddldp; // derivative of dls by pressure
-		properties->ddvdp = satPropClose2Crit.ddvdp; // derivative of dvs by pressure
-		properties->dhldp = satPropClose2Crit.dhldp; // derivative of hls by pressure
-		properties->dhvdp = satPropClose2Crit.dhvdp; // derivative of hvs by pressure
-		properties->dl = satPropClose2Crit.dl;	// bubble density
-		properties->dv = satPropClose2Crit.dv;	// dew density
-		properties->hl = satPropClose2Crit.hl;	// bubble specific enthalpy
-		properties->hv = satPropClose2Crit.hv;	// dew specific enthalpy
-		properties->psat = satPropClose2Crit.psat;             // saturation pressure
+		properties->Tsat = _satPropClose2Crit.Tsat;		// saturation temperature
+		properties->dTp = _satPropClose2Crit.dTp;  // derivative of Ts by pressure
+		properties->ddldp = _satPropClose2Crit.ddldp; // derivative of dls by pressure
+		properties->ddvdp = _satPropClose2Crit.ddvdp; // derivative of dvs by pressure
+		properties->dhldp = _satPropClose2Crit.dhldp; // derivative of hls by pressure
+		properties->dhvdp = _satPropClose2Crit.dhvdp; // derivative of hvs by pressure
+		properties->dl = _satPropClose2Crit.dl;	// bubble density
+		properties->dv = _satPropClose2Crit.dv;	// dew density
+		properties->hl = _satPropClose2Crit.hl;	// bubble specific enthalpy
+		properties->hv = _satPropClose2Crit.hv;	// dew specific enthalpy
+		properties->psat = _satPropClose2Crit.psat;             // saturation pressure
 	}
 }
 
@@ -251,6 +360,11 @@ void FluidPropSolver::setSat_T(double &T, ExternalSaturationProperties *const pr
     the phase input is returned in the state record
 */
 void FluidPropSolver::setState_ph(double &p, double &h, int &phase, ExternalThermodynamicState *const properties){
+	// States close to the critical point are interpolated in the critical band if enabled
+	CriticalBand *band = criticalBand();
+	if (band != NULL && band->setState_ph(p, h, *this, properties))
+		return;
+
 	string ErrorMsg;
 	// FluidProp variables (in SI units)
     double P_, T_, v_, d_, h_, s_, u_, q_, x_[20], y_[20],
@@ -410,25 +524,15 @@ void FluidPropSolver::setState_ps(double &p, double &s, int &phase, ExternalTher
   This function sets the bubble state record bubbleProperties corresponding to the
   saturation data contained in the properties record.
 
-  Due to current lack of direct control over the phase in FluidProp, a small delta is added to
-  the dewpoint enthalpy to make sure the correct phase is selected.
+  The state is assembled from the saturated liquid state computed by setSat_p
+  or setSat_T, without calling FluidProp again.
   @param properties ExternalSaturationProperties record with saturation properties data
   @param phase Phase (1: one-phase, 2: two-phase)
   @param bubbleProperties ExternalThermodynamicState record where to write the bubble point properties
 */
 void FluidPropSolver::setBubbleState(ExternalSaturationProperties *const properties, int phase,
 		                             ExternalThermodynamicState *const bubbleProperties){
-	// Set the bubble state property record based on the saturation properties record
-    double hl;
-
-	if (phase == 0)
-		hl = properties->hl;
-	else if (phase == 1) // liquid phase
-		hl = properties->hl-delta_h;
-	else                 // two-phase mixture
-		hl = properties->hl+delta_h;
-
-	setState_ph(properties->psat, hl, phase, bubbleProperties);
+	setSaturationBoundaryState(properties, true, phase, bubbleProperties);
 }
 
 //! Set dew state
@@ -436,28 +540,70 @@ void FluidPropSolver::setBubbleState(ExternalSaturationProperties *const propert
   This function sets the dew state record dewProperties corresponding to the
   saturation data contained in the properties record.
 
-  The default implementation of the setDewState function is relying on the correct
-  behaviour of setState_ph with respect to the state input. Can be overridden
-  in the specific solver code to get more efficient or correct handling of this situation.
+  The state is assembled from the saturated vapour state, which is computed
+  once per saturation record.
   @param properties ExternalSaturationProperties record with saturation properties data
   @param phase Phase (1: one-phase, 2: two-phase)
   @param dewProperties ExternalThermodynamicState record where to write the dew point properties
 */
 void FluidPropSolver::setDewState(ExternalSaturationProperties *const properties, int phase,
 		                          ExternalThermodynamicState *const dewProperties){
-	// Set the dew state property record based on the saturation properties record
-    double hv;
+	setSaturationBoundaryState(properties, false, phase, dewProperties);
+}
 
-	if (phase == 0)
-		hv = properties->hv;
-	else if (phase == 1) // liquid phase
-		hv = properties->hv+delta_h;
-	else                 // two-phase mixture
-		hv = properties->hv-delta_h;
+//! Compute a saturated phase state
+/*!
+  This function computes the properties of the saturated liquid or vapour
+  phase at the saturation pressure of the properties record.
+  @param properties ExternalSaturationProperties record with saturation properties data
+  @param liquid True for the saturated liquid, false for the saturated vapour
+  @param saturatedProperties ExternalThermodynamicState record where to write the properties
+*/
+void FluidPropSolver::setSaturatedState(ExternalSaturationProperties *const properties, bool liquid,
+		                                ExternalThermodynamicState *const saturatedProperties){
+	string ErrorMsg;
+	// FluidProp variables (in SI units)
+    double P_, T_, v_, d_, h_, s_, u_, q_, x_[20], y_[20],
+		   cv_, cp_, c_, alpha_, beta_, chi_, fi_, ksi_,
+		   psi_, zeta_, theta_, kappa_, gamma_, eta_, lambda_,
+		   d_liq_, d_vap_, h_liq_, h_vap_, T_sat_, dd_liq_dP_, dd_vap_dP_, dh_liq_dP_,
+		   dh_vap_dP_, dT_sat_dP_;
 
-	setState_ph(properties->psat, hv, phase, dewProperties);
+	FluidProp.AllPropsSat("Pq", properties->psat, liquid ? 0.0 : 1.0, P_, T_, v_, d_, h_, s_, u_, q_, x_, y_, cv_, cp_, c_,
+						   alpha_, beta_, chi_, fi_, ksi_, psi_, zeta_, theta_, kappa_, gamma_, eta_, lambda_,
+						   d_liq_, d_vap_, h_liq_, h_vap_, T_sat_, dd_liq_dP_, dd_vap_dP_, dh_liq_dP_,
+						   dh_vap_dP_, dT_sat_dP_, &ErrorMsg);
+	if (isError(ErrorMsg)) {  // An error occurred
+		// Build error message and pass it to the Modelica environment
+		char error[300];
+		sprintf(error, "FluidProp error in FluidPropSolver::setSaturatedState(%f)\n %s\n", properties->psat, ErrorMsg.c_str());
+		errorMessage(error);
+	}
+	*saturatedProperties = saturatedState(P_, T_, d_, h_, s_, cv_, cp_, c_, theta_, kappa_, eta_, lambda_);
 }
 
+//! Build a saturated phase state record from FluidProp outputs
+ExternalThermodynamicState FluidPropSolver::saturatedState(double p, double T, double d, double h, double s,
+														   double cv, double cp, double a, double beta,
+														   double kappa, double eta, double lambda){
+	ExternalThermodynamicState state;
+	state.p = p;					// pressure
+	state.T = T;					// temperature
+	state.d = d;					// density
+	state.h = h;					// specific enthalpy
+	state.s = s;					// specific entropy
+	state.cv = cv;					// specific heat capacity cv
+	state.cp = cp;					// specific heat capacity cp
+	state.a = a;					// speed of sound
+	state.beta = beta;				// isothermal expansion coefficient
+	state.kappa = kappa;			// compressibility
+	state.eta = eta;				// dynamic viscosity
+	state.lambda = lambda;			// thermal conductivity
+	state.ddhp = NAN;				// set by setSaturationBoundaryState
+	state.ddph = NAN;				// set by setSaturationBoundaryState
+	state.phase = 1;				// phase
+	return state;
+}
 
 //! Compute isentropic enthalpy
 /*!
@@ -37,14 +37,16 @@
 
 #include "include.h"
 #include "basesolver.h"
+#include "criticalband.h"
 
 #include "FluidProp_IF.h"
 
-class FluidPropSolver : public BaseSolver{
+class FluidPropSolver : public BaseSolver, private CriticalBandSource{
 public:
 	FluidPropSolver(const string &mediumName, const string &libraryName, const string &substanceName);
 	~FluidPropSolver();
 	virtual void setFluidConstants();
+	virtual size_t memoryUsage();
 
 	virtual void setSat_p(double &p, ExternalSaturationProperties *const properties);
 	virtual void setSat_T(double &T, ExternalSaturationProperties *const properties);
@@ -63,6 +65,27 @@ protected:
     TFluidProp FluidProp;  // Instance of FluidProp wrapper object
 	bool isError(string ErrorMsg);
 	bool licenseError(string ErrorMsg);
+	virtual void setSaturatedState(ExternalSaturationProperties *const properties, bool liquid,
+		                           ExternalThermodynamicState *const saturatedProperties);
+	ExternalThermodynamicState saturatedState(double p, double T, double d, double h, double s,
+											  double cv, double cp, double a, double beta,
+											  double kappa, double eta, double lambda);
+	CriticalBand *criticalBand();
+	virtual bool bandSaturation(double p, ExternalSaturationProperties *const properties);
+	virtual int tableNode(double p, double h, ExternalThermodynamicState *const properties);
+
+	//! Saturation properties close to critical conditions
+	ExternalSaturationProperties _satPropClose2Crit;
+	//! Relative tolerance margin for subcritical pressure conditions
+	double _p_eps;
+	//! Relative tolerance margin for supercritical temperature conditions
+	double _T_eps;
+	//! Tables around the critical point, NULL if disabled, see criticalband.h
+	CriticalBand *_criticalBand;
+	//! Set when _criticalBand has been set
+	OnceFlag _criticalBandOnce;
+	//! Serializes the publication of _criticalBand
+	Mutex _criticalBandMutex;
 };
 
 
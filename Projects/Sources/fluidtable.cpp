@@ -0,0 +1,36 @@
+/* *****************************************************************
+ * Implementation of the built-in table of fluid constants
+ ********************************************************************/
+
+#include "fluidtable.h"
+
+// Defines fluidTableVersion and the fluidTable array, terminated by an
+// entry without substance name. With GENERATED_FLUIDTABLE, the table is
+// the one generated by the build, found on the include path before the
+// placeholder in this directory.
+#ifdef GENERATED_FLUIDTABLE
+#include <fluidtable.inc>
+#else
+#include "fluidtable.inc"
+#endif
+
+//! Find the entry of a fluid
+/*!
+  Returns NULL if the fluid is not in the table, or if the table was
+  generated with a different backend version.
+  @param backendVersion Version of the backend used by the solver
+  @param substanceName Substance name without options
+*/
+const FluidTableEntry *FluidTable::find(const string &backendVersion, const string &substanceName){
+	if (backendVersion.compare(fluidTableVersion) != 0)
+		return NULL;
+	for (const FluidTableEntry *entry = fluidTable; entry->substanceName != NULL; entry++)
+		if (substanceName.compare(entry->substanceName) == 0)
+			return entry;
+	return NULL;
+}
+
+//! Return the backend version the table was generated with, empty if the table is empty
+const char *FluidTable::version(){
+	return fluidTableVersion;
+}
@@ -0,0 +1,46 @@
+/*!
+  \file fluidtable.h
+  \brief Built-in table of the fluid constants of common fluids
+
+  The molar mass, the critical point and the near-critical saturation
+  properties of frequently used fluids are compiled into the library, so
+  that the constant getters need no backend call at all. The table is a
+  statically initialised array in fluidtable.inc, generated at build time
+  by Tools/fluidtablegen with the backend the library is linked with; the
+  entries are only used if the backend version matches the one the table
+  was generated with. The file in the repository is an empty placeholder,
+  used by the builds that do not generate the table.
+*/
+
+#ifndef FLUIDTABLE_H_
+#define FLUIDTABLE_H_
+
+#include "include.h"
+#include "externalmedialib.h"
+
+//! Entry of the fluid table
+struct FluidTableEntry{
+	//! Substance name, as passed to the solver without options
+	const char *substanceName;
+	//! Molar mass
+	double MM;
+	//! Pressure at critical point
+	double pc;
+	//! Temperature at critical point
+	double Tc;
+	//! Density at critical point
+	double dc;
+	//! Relative distance of the near-critical saturation pressure from the critical one
+	double p_eps;
+	//! Saturation properties at pc*(1 - p_eps)
+	ExternalSaturationProperties close2Crit;
+};
+
+//! Built-in fluid table
+class FluidTable{
+public:
+	static const FluidTableEntry *find(const string &backendVersion, const string &substanceName);
+	static const char *version();
+};
+
+#endif // FLUIDTABLE_H_
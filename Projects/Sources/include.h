@@ -108,6 +108,13 @@ Overwrite FluidProp inclusion if not on Windows
 #  define FLUIDPROP 0
 #endif
 
+/*!
+snprintf is only available as _snprintf before Visual Studio 2015
+ */
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#  define snprintf _snprintf
+#endif
+
 
 
 // General purpose includes
@@ -0,0 +1,201 @@
+/* *****************************************************************
+ * Implementation of the parallel evaluation of batched property calls
+ ********************************************************************/
+
+#include "parallelbatch.h"
+#include "basesolver.h"
+#include "solvermap.h"
+#include "threadpool.h"
+#include <vector>
+
+//! Batched setState task
+class SetStatesTask : public ThreadPoolTask{
+public:
+	SetStatesTask(const std::vector<BaseSolver*> &solvers, int inputChoice, const double *input1, const double *input2,
+				  const int *phase, bool ordered, ExternalThermodynamicState *const properties)
+		: _solvers(solvers), _inputChoice(inputChoice), _input1(input1), _input2(input2), _phase(phase),
+		  _ordered(ordered), _properties(properties){}
+
+	virtual void execute(int worker, int begin, int end){
+		// Worker threads do not go through SolverMap::getSolver, which resets the call options
+		BaseSolver::resetCallOptions();
+		_solvers[worker]->setStates(_inputChoice, end - begin, _input1 + begin, _input2 + begin,
+									_phase ? _phase + begin : NULL, _ordered, _properties + begin);
+	}
+
+private:
+	const std::vector<BaseSolver*> &_solvers;
+	int _inputChoice;
+	const double *_input1;
+	const double *_input2;
+	const int *_phase;
+	bool _ordered;
+	ExternalThermodynamicState *const _properties;
+};
+
+//! Output arrays starting at the given element
+static ExternalThermodynamicStateArrays offsetArrays(const ExternalThermodynamicStateArrays &arrays, int begin){
+	ExternalThermodynamicStateArrays result;
+	result.T      = arrays.T      ? arrays.T + begin      : NULL;
+	result.a      = arrays.a      ? arrays.a + begin      : NULL;
+	result.beta   = arrays.beta   ? arrays.beta + begin   : NULL;
+	result.cp     = arrays.cp     ? arrays.cp + begin     : NULL;
+	result.cv     = arrays.cv     ? arrays.cv + begin     : NULL;
+	result.d      = arrays.d      ? arrays.d + begin      : NULL;
+	result.ddhp   = arrays.ddhp   ? arrays.ddhp + begin   : NULL;
+	result.ddph   = arrays.ddph   ? arrays.ddph + begin   : NULL;
+	result.eta    = arrays.eta    ? arrays.eta + begin    : NULL;
+	result.h      = arrays.h      ? arrays.h + begin      : NULL;
+	result.kappa  = arrays.kappa  ? arrays.kappa + begin  : NULL;
+	result.lambda = arrays.lambda ? arrays.lambda + begin : NULL;
+	result.p      = arrays.p      ? arrays.p + begin      : NULL;
+	result.phase  = arrays.phase  ? arrays.phase + begin  : NULL;
+	result.s      = arrays.s      ? arrays.s + begin      : NULL;
+	return result;
+}
+
+//! Batched setState task writing to separate arrays per property
+class SetStatesArraysTask : public ThreadPoolTask{
+public:
+	SetStatesArraysTask(const std::vector<BaseSolver*> &solvers, int inputChoice, const double *input1, const double *input2,
+						const int *phase, bool ordered, const ExternalThermodynamicStateArrays &properties)
+		: _solvers(solvers), _inputChoice(inputChoice), _input1(input1), _input2(input2), _phase(phase),
+		  _ordered(ordered), _properties(properties){}
+
+	virtual void execute(int worker, int begin, int end){
+		BaseSolver::resetCallOptions();
+		_solvers[worker]->setStates_arrays(_inputChoice, end - begin, _input1 + begin, _input2 + begin,
+										   _phase ? _phase + begin : NULL, _ordered, offsetArrays(_properties, begin));
+	}
+
+private:
+	const std::vector<BaseSolver*> &_solvers;
+	int _inputChoice;
+	const double *_input1;
+	const double *_input2;
+	const int *_phase;
+	bool _ordered;
+	const ExternalThermodynamicStateArrays &_properties;
+};
+
+//! Batched setSat task
+class SetSatsTask : public ThreadPoolTask{
+public:
+	SetSatsTask(const std::vector<BaseSolver*> &solvers, bool byPressure, const double *input,
+				ExternalSaturationProperties *const properties)
+		: _solvers(solvers), _byPressure(byPressure), _input(input), _properties(properties){}
+
+	virtual void execute(int worker, int begin, int end){
+		BaseSolver::resetCallOptions();
+		_solvers[worker]->setSats(_byPressure, end - begin, _input + begin, _properties + begin);
+	}
+
+private:
+	const std::vector<BaseSolver*> &_solvers;
+	bool _byPressure;
+	const double *_input;
+	ExternalSaturationProperties *const _properties;
+};
+
+//! Collect the solvers of the workers that can be used for a batch of n elements
+static void workerSolvers(const string &mediumName, const string &libraryName, const string &substanceName,
+						  int n, std::vector<BaseSolver*> &solvers){
+	BaseSolver *solver = SolverMap::getSolver(mediumName, libraryName, substanceName);
+	solvers.push_back(solver);
+	if (!solver->isReentrant())
+		return;
+	int workers = ThreadPool::instance().workers(n);
+	for (int i = 1; i < workers; i++)
+		solvers.push_back(SolverMap::getWorkerSolver(i, mediumName, libraryName, substanceName));
+	// Data computed on first need is computed here on the calling thread,
+	// so that errors are reported directly and the workers do not build
+	// shared data of the external library concurrently
+	if (solvers.size() > 1)
+		for (unsigned int i = 0; i < solvers.size(); i++)
+			solvers[i]->prepare();
+}
+
+//! Compute properties for an array of inputs, in parallel if possible
+/*!
+  The first element is computed on the calling thread before the batch is
+  distributed, so that data built lazily by the external library on first
+  use is available to all the workers. The workers get contiguous ranges
+  of elements, so that ordered batches keep their order within each range.
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param n Number of elements
+  @param input1 Array of first inputs
+  @param input2 Array of second inputs
+  @param phase Array of phases, can be NULL
+  @param ordered True if consecutive elements are neighbours
+  @param properties Array of ExternalThermodynamicState property structs
+*/
+void setStatesParallel(const string &mediumName, const string &libraryName, const string &substanceName,
+					   int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+					   bool ordered, ExternalThermodynamicState *const properties){
+	std::vector<BaseSolver*> solvers;
+	workerSolvers(mediumName, libraryName, substanceName, n, solvers);
+	if (solvers.size() == 1 || n < 2){
+		solvers[0]->setStates(inputChoice, n, input1, input2, phase, ordered, properties);
+		return;
+	}
+	solvers[0]->setStates(inputChoice, 1, input1, input2, phase, ordered, properties);
+	SetStatesTask task(solvers, inputChoice, input1 + 1, input2 + 1, phase ? phase + 1 : NULL, ordered, properties + 1);
+	ThreadPool::instance().run(n - 1, (int)solvers.size(), task);
+}
+
+//! Compute properties for an array of inputs into separate arrays per property, in parallel if possible
+/*!
+  Same as setStatesParallel, but the results are written to the non-NULL
+  arrays of the output descriptor and only the corresponding properties
+  are computed.
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+  @param inputChoice Input pair (see CHOICE_xx in externalmedialib.h)
+  @param n Number of elements
+  @param input1 Array of first inputs
+  @param input2 Array of second inputs
+  @param phase Array of phases, can be NULL
+  @param ordered True if consecutive elements are neighbours
+  @param properties Output arrays
+*/
+void setStatesArraysParallel(const string &mediumName, const string &libraryName, const string &substanceName,
+							 int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+							 bool ordered, const ExternalThermodynamicStateArrays &properties){
+	std::vector<BaseSolver*> solvers;
+	workerSolvers(mediumName, libraryName, substanceName, n, solvers);
+	if (solvers.size() == 1 || n < 2){
+		solvers[0]->setStates_arrays(inputChoice, n, input1, input2, phase, ordered, properties);
+		return;
+	}
+	solvers[0]->setStates_arrays(inputChoice, 1, input1, input2, phase, ordered, properties);
+	ExternalThermodynamicStateArrays rest = offsetArrays(properties, 1);
+	SetStatesArraysTask task(solvers, inputChoice, input1 + 1, input2 + 1, phase ? phase + 1 : NULL, ordered, rest);
+	ThreadPool::instance().run(n - 1, (int)solvers.size(), task);
+}
+
+//! Compute saturation properties for an array of inputs, in parallel if possible
+/*!
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+  @param byPressure True if the inputs are pressures, false if they are temperatures
+  @param n Number of elements
+  @param input Array of pressures or temperatures
+  @param properties Array of ExternalSaturationProperties property structs
+*/
+void setSatsParallel(const string &mediumName, const string &libraryName, const string &substanceName,
+					 bool byPressure, int n, const double *input, ExternalSaturationProperties *const properties){
+	std::vector<BaseSolver*> solvers;
+	workerSolvers(mediumName, libraryName, substanceName, n, solvers);
+	if (solvers.size() == 1 || n < 2){
+		solvers[0]->setSats(byPressure, n, input, properties);
+		return;
+	}
+	solvers[0]->setSats(byPressure, 1, input, properties);
+	SetSatsTask task(solvers, byPressure, input + 1, properties + 1);
+	ThreadPool::instance().run(n - 1, (int)solvers.size(), task);
+}
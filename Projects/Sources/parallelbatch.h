@@ -0,0 +1,26 @@
+/*!
+  \file parallelbatch.h
+  \brief Parallel evaluation of batched property calls
+
+  Batches are distributed over the thread pool (see threadpool.h) when
+  the solver is reentrant and the batch is large enough; each worker
+  thread uses its own solver instance. Otherwise the batch is evaluated
+  by the solver on the calling thread.
+*/
+
+#ifndef PARALLELBATCH_H_
+#define PARALLELBATCH_H_
+
+#include "include.h"
+#include "externalmedialib.h"
+
+void setStatesParallel(const string &mediumName, const string &libraryName, const string &substanceName,
+					   int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+					   bool ordered, ExternalThermodynamicState *const properties);
+void setStatesArraysParallel(const string &mediumName, const string &libraryName, const string &substanceName,
+							 int inputChoice, int n, const double *input1, const double *input2, const int *phase,
+							 bool ordered, const ExternalThermodynamicStateArrays &properties);
+void setSatsParallel(const string &mediumName, const string &libraryName, const string &substanceName,
+					 bool byPressure, int n, const double *input, ExternalSaturationProperties *const properties);
+
+#endif // PARALLELBATCH_H_
@@ -0,0 +1,128 @@
+/* *****************************************************************
+ * Implementation of the eager preparation of solvers
+ ********************************************************************/
+
+#include "prewarm.h"
+#include "basesolver.h"
+#include "solvermap.h"
+#include "threadpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+//! Prepares groups of solvers, one group per element
+class PrewarmTask : public ThreadPoolTask{
+public:
+	PrewarmTask(const std::vector<std::vector<BaseSolver*> > &groups) : _groups(groups){}
+	virtual void execute(int worker, int begin, int end){
+		for (int i = begin; i < end; i++)
+			for (unsigned int j = 0; j < _groups[i].size(); j++)
+				_groups[i][j]->prepare();
+	}
+private:
+	const std::vector<std::vector<BaseSolver*> > &_groups;
+};
+
+//! Create and prepare the solvers of a media list
+/*!
+  The solvers are created on the calling thread, in the context bound to
+  it. The solvers that are reentrant are then prepared on the thread pool;
+  solvers of the same library and base substance (the substance name
+  without options) are prepared one after the other by the same thread,
+  since they share data of the external library. The other solvers are
+  prepared on the calling thread. Invalid entries are skipped with a
+  warning, since an error would stop the model that first uses the
+  context. Returns the number of solvers.
+  @param media Media list, see prewarm.h
+*/
+int prewarmSolvers(const string &media){
+	// Parse the list and create the solvers
+	std::vector<BaseSolver*> serial;
+	std::vector<std::vector<BaseSolver*> > groups;
+	std::vector<string> groupKeys;
+	int count = 0;
+	string::size_type begin = 0;
+	while (begin < media.size()){
+		string::size_type end = media.find_first_of(";\n", begin);
+		if (end == string::npos)
+			end = media.size();
+		string entry(media.substr(begin, end - begin));
+		begin = end + 1;
+
+		// Trim blanks and carriage returns
+		string::size_type first = entry.find_first_not_of(" \t\r");
+		string::size_type last = entry.find_last_not_of(" \t\r");
+		if (first == string::npos || entry[first] == '#')
+			continue;
+		entry = entry.substr(first, last - first + 1);
+		string::size_type colon = entry.find(':');
+		if (colon == string::npos){
+			char warning[300];
+			snprintf(warning, sizeof(warning), "Warning: skipping the entry \"%.200s\" of the list of media to prepare, the format is libraryName:substanceName\n", entry.c_str());
+			warningMessage(warning);
+			continue;
+		}
+		string libraryName(entry.substr(0, colon));
+		string substanceName(entry.substr(colon + 1));
+		string error(SolverMap::checkSolver(libraryName, substanceName));
+		if (!error.empty()){
+			char warning[500];
+			snprintf(warning, sizeof(warning), "Warning: skipping the entry \"%.200s\" of the list of media to prepare: %.200s\n", entry.c_str(), error.c_str());
+			warningMessage(warning);
+			continue;
+		}
+		BaseSolver *solver = SolverMap::getSolver(substanceName, libraryName, substanceName);
+		count++;
+		if (!solver->isReentrant()){
+			serial.push_back(solver);
+			continue;
+		}
+		string groupKey(SolverMap::solverKey(libraryName, substanceName.substr(0, substanceName.find('|'))));
+		unsigned int group = 0;
+		while (group < groupKeys.size() && groupKeys[group] != groupKey)
+			group++;
+		if (group == groupKeys.size()){
+			groupKeys.push_back(groupKey);
+			groups.push_back(std::vector<BaseSolver*>());
+		}
+		groups[group].push_back(solver);
+	}
+
+	for (unsigned int i = 0; i < serial.size(); i++)
+		serial[i]->prepare();
+	if (!groups.empty()){
+		PrewarmTask task(groups);
+		ThreadPool::instance().run((int)groups.size(), (int)groups.size(), task, 1);
+	}
+	return count;
+}
+
+//! Create and prepare the solvers listed in the environment
+/*!
+  Reads the media list from the environment variable EXTERNALMEDIA_PREWARM
+  and from the file named by EXTERNALMEDIA_PREWARM_FILE, see prewarm.h.
+  Returns the number of solvers.
+*/
+int prewarmSolversFromEnvironment(){
+	string media;
+	const char *list = getenv("EXTERNALMEDIA_PREWARM");
+	if (list != NULL)
+		media = list;
+	const char *fileName = getenv("EXTERNALMEDIA_PREWARM_FILE");
+	if (fileName != NULL && fileName[0] != '\0'){
+		FILE *file = fopen(fileName, "r");
+		if (file == NULL){
+			char warning[300];
+			snprintf(warning, sizeof(warning), "Warning: cannot read the list of media to prepare from %.200s\n", fileName);
+			warningMessage(warning);
+		}
+		else {
+			media += "\n";
+			int c;
+			while ((c = fgetc(file)) != EOF)
+				media += (char)c;
+			fclose(file);
+		}
+	}
+	return media.empty() ? 0 : prewarmSolvers(media);
+}
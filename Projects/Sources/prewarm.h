@@ -0,0 +1,31 @@
+/*!
+  \file prewarm.h
+  \brief Eager preparation of solvers before the simulation starts
+
+  Solvers are normally created by the first call that uses them and
+  compute their data on first need, so that a model with many media
+  spends its initialisation preparing them one after the other. The
+  media listed here are instead created up front, and their constants,
+  near-critical saturation properties and look-up tables are computed
+  concurrently on the thread pool (see threadpool.h).
+
+  A media list has one entry per medium, separated by semicolons or line
+  feeds, each made of the library name and the substance name separated
+  by a colon, e.g. "CoolProp:Water;CoolProp:R134a|enable_TTSE=1". Empty
+  entries and lines starting with '#' are ignored. Entries with an unknown
+  library, base substance or option are skipped with a warning.
+
+  The default context prepares the media listed in the environment
+  variable EXTERNALMEDIA_PREWARM and in the file named by the environment
+  variable EXTERNALMEDIA_PREWARM_FILE when it is first used.
+*/
+
+#ifndef PREWARM_H_
+#define PREWARM_H_
+
+#include "include.h"
+
+int prewarmSolvers(const string &media);
+int prewarmSolversFromEnvironment();
+
+#endif // PREWARM_H_
@@ -2,6 +2,7 @@
 #include "basesolver.h"
 #include "testsolver.h"
 #include "include.h"
+#include "prewarm.h"
 
 #if (FLUIDPROP == 1)
 #include "fluidpropsolver.h"
@@ -11,49 +12,332 @@
 #include "coolpropsolver.h"
 #endif // COOLPROP == 1
 
+//! Create an empty context
+SolverMap::SolverMap(){
+}
+
+//! Destroy the context
+/*!
+  All the solvers of the context are deleted. The context must not be in
+  use by any thread.
+*/
+SolverMap::~SolverMap(){
+	releaseAll();
+}
+
+//! Set once the preparation of the media listed in the environment has started
+static OnceFlag prewarmed;
+static Mutex prewarmMutex;
+static bool prewarmStarted = false;
+
+//! Return the context of the calling thread
+/*!
+  This is the context bound with bind(), or the default context, which
+  is created on first use and kept until the process exits. The first
+  thread using the default context prepares the media listed in the
+  environment (see prewarm.h); the threads arriving meanwhile do not wait.
+*/
+SolverMap *SolverMap::current(){
+	if (_boundContext != NULL)
+		return _boundContext;
+	static SolverMap *defaultContext = new SolverMap();
+	if (!prewarmed.done()){
+		bool start;
+		{
+			ScopedLock lock(prewarmMutex);
+			start = !prewarmStarted;
+			prewarmStarted = true;
+		}
+		if (start){
+			// Marked first, since the preparation uses the default context itself
+			prewarmed.setDone();
+			prewarmSolversFromEnvironment();
+		}
+	}
+	return defaultContext;
+}
+
+//! Bind a context to the calling thread
+/*!
+  All the subsequent calls of the calling thread use the solvers of the
+  given context, until another context is bound. Returns the previously
+  bound context, so that it can be restored.
+  @param context Context to bind, NULL for the default context
+*/
+SolverMap *SolverMap::bind(SolverMap *context){
+	SolverMap *previous = _boundContext;
+	_boundContext = context;
+	return previous;
+}
+
 //! Get a specific solver
 /*!
   This function returns the solver for the specified library name, substance name
   and possibly medium name. It creates a new solver if the solver does not already
-  exist. When implementing new solvers, one has to add the newly created solvers to
-  this function. An error message is generated if the specific library is not supported
-  by the interface library.
+  exist. The solver belongs to the context of the calling thread.
+  All the calls of the library start here, so the options of the previous
+  call of the thread are reset, see BaseSolver::resetCallOptions().
   @param mediumName Medium name
   @param libraryName Library name
   @param substanceName Substance name
 */
 BaseSolver *SolverMap::getSolver(const string &mediumName, const string &libraryName, const string &substanceName){
-	// Get solver key from library and substance name
+	BaseSolver::resetCallOptions();
+	return current()->solver(solverKey(libraryName, substanceName), mediumName, libraryName, substanceName);
+};
+
+//! Get the solver instance of a worker thread
+/*!
+  This function returns the solver used by the given worker of the thread
+  pool. Worker 0 is the calling thread and uses the solver returned by
+  getSolver; the other workers get separate instances, created on first
+  use, so that they do not share the state of the solver object. It must
+  be called from the thread that owns the context, not from the workers.
+  @param worker Worker index
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+BaseSolver *SolverMap::getWorkerSolver(int worker, const string &mediumName, const string &libraryName, const string &substanceName){
+	if (worker == 0)
+		return getSolver(mediumName, libraryName, substanceName);
+	char suffix[20];
+	sprintf(suffix, "#%d", worker);
+	return current()->solver(solverKey(libraryName, substanceName) + suffix, mediumName, libraryName, substanceName);
+}
+
+//! Acquire a reference to a solver
+/*!
+  This function creates the solver if needed and increments its reference
+  count, so that it is kept until the reference is released. Returns the
+  new reference count.
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+int SolverMap::acquire(const string &mediumName, const string &libraryName, const string &substanceName){
+	string solverKeyString(solverKey(libraryName, substanceName));
+	solver(solverKeyString, mediumName, libraryName, substanceName);
+	ScopedLock lock(_solversMutex);
+	return ++_references[solverKeyString];
+}
+
+//! Release a reference to a solver
+/*!
+  This function decrements the reference count of the solver, and deletes
+  the solver together with its worker instances when no reference is left.
+  Solvers that were only used implicitly, without acquire(), have no
+  references and are deleted right away. They are created again on next
+  use. Returns the remaining reference count.
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+int SolverMap::release(const string &libraryName, const string &substanceName){
+	string solverKeyString(solverKey(libraryName, substanceName));
+	ScopedLock lock(_solversMutex);
+	map<string, int>::iterator it = _references.find(solverKeyString);
+	if (it != _references.end() && --it->second > 0)
+		return it->second;
+	if (it != _references.end())
+		_references.erase(it);
+	deleteSolvers(solverKeyString);
+	return 0;
+}
+
+//! Release all the solvers
+/*!
+  This function deletes all the solvers of the context, regardless of
+  their reference counts. The solvers must not be in use by any thread.
+*/
+void SolverMap::releaseAll(){
+	ScopedLock lock(_solversMutex);
+	for (map<string, BaseSolver*>::iterator it = _solvers.begin(); it != _solvers.end(); ++it)
+		delete it->second;
+	_solvers.clear();
+	_references.clear();
+}
+
+//! Return the memory used by a solver
+/*!
+  Returns the estimate of BaseSolver::memoryUsage for the solver, without
+  its worker instances, or 0 if the solver does not exist in this context.
+  The solver is not created.
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+size_t SolverMap::memoryUsage(const string &libraryName, const string &substanceName){
+	ScopedLock lock(_solversMutex);
+	map<string, BaseSolver*>::iterator it = _solvers.find(solverKey(libraryName, substanceName));
+	return it != _solvers.end() ? it->second->memoryUsage() : 0;
+}
+
+//! Return a report of the memory used by the solvers
+/*!
+  The report has one line per solver, with the solver key, the estimated
+  memory in bytes and the reference count. The worker instances are
+  counted with the solver they belong to.
+*/
+string SolverMap::memoryReport(){
+	ScopedLock lock(_solversMutex);
+	map<string, size_t> usage;
+	size_t total = 0;
+	for (map<string, BaseSolver*>::iterator it = _solvers.begin(); it != _solvers.end(); ++it){
+		size_t bytes = it->second->memoryUsage();
+		usage[it->first.substr(0, it->first.find('#'))] += bytes;
+		total += bytes;
+	}
+	string report;
+	char line[100];
+	for (map<string, size_t>::iterator it = usage.begin(); it != usage.end(); ++it){
+		map<string, int>::iterator references = _references.find(it->first);
+		snprintf(line, sizeof(line), ": %lu bytes, %d references\n", (unsigned long)it->second,
+			references != _references.end() ? references->second : 0);
+		report += it->first + line;
+	}
+	snprintf(line, sizeof(line), "Total: %lu bytes\n", (unsigned long)total);
+	return report + line;
+}
+
+//! Add the counters of solver statistics to a total
+static void addStatistics(SolverStatistics &total, const SolverStatistics &statistics){
+	total.coldFlashes += statistics.coldFlashes;
+	total.warmFlashes += statistics.warmFlashes;
+	total.tableEvaluations += statistics.tableEvaluations;
+	total.exactEvaluations += statistics.exactEvaluations;
+}
+
+//! Return the statistics of a solver summed with those of its worker instances
+/*!
+  The batched calls count the flashes and state updates of their worker
+  threads in the worker instances, see getWorkerSolver. All the counters
+  are zero if the solver does not exist in this context.
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+SolverStatistics SolverMap::statistics(const string &libraryName, const string &substanceName){
+	SolverStatistics total = {0, 0, 0, 0};
 	string solverKeyString(solverKey(libraryName, substanceName));
-	// Check whether solver already exists
-	if (_solvers.find(solverKeyString) != _solvers.end())
-		return _solvers[solverKeyString];
-	// Create new solver if it doesn't exist
+	string workerPrefix(solverKeyString + "#");
+	ScopedLock lock(_solversMutex);
+	map<string, BaseSolver*>::iterator it = _solvers.find(solverKeyString);
+	if (it != _solvers.end())
+		addStatistics(total, it->second->statistics());
+	// Worker instances are stored with the key followed by '#'
+	for (it = _solvers.lower_bound(workerPrefix);
+		 it != _solvers.end() && it->first.compare(0, workerPrefix.size(), workerPrefix) == 0; ++it)
+		addStatistics(total, it->second->statistics());
+	return total;
+}
+
+//! Delete a solver and its worker instances
+/*!
+  Must be called with the map locked.
+  @param solverKeyString Solver key
+*/
+void SolverMap::deleteSolvers(const string &solverKeyString){
+	map<string, BaseSolver*>::iterator it = _solvers.find(solverKeyString);
+	if (it != _solvers.end()){
+		delete it->second;
+		_solvers.erase(it);
+	}
+	// Worker instances are stored with the key followed by '#'
+	string workerPrefix(solverKeyString + "#");
+	it = _solvers.lower_bound(workerPrefix);
+	while (it != _solvers.end() && it->first.compare(0, workerPrefix.size(), workerPrefix) == 0){
+		delete it->second;
+		_solvers.erase(it++);
+	}
+}
+
+//! Get a solver of this context
+/*!
+  This function returns the solver stored with the given key, and creates
+  it if it does not already exist.
+  @param solverKeyString Solver key
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+BaseSolver *SolverMap::solver(const string &solverKeyString, const string &mediumName, const string &libraryName, const string &substanceName){
+	{
+		ScopedLock lock(_solversMutex);
+		// Check whether solver already exists
+		map<string, BaseSolver*>::iterator it = _solvers.find(solverKeyString);
+		if (it != _solvers.end())
+			return it->second;
+	}
+	// Create new solver if it doesn't exist; the lock is not held here,
+	// since the error function of the Modelica tool may not return
+	BaseSolver *newSolver = createSolver(mediumName, libraryName, substanceName);
+	ScopedLock lock(_solversMutex);
+	map<string, BaseSolver*>::iterator it = _solvers.find(solverKeyString);
+	if (it != _solvers.end()){
+		// Created meanwhile by another thread
+		delete newSolver;
+		return it->second;
+	}
+	_solvers[solverKeyString] = newSolver;
+	return newSolver;
+}
+
+//! Create a new solver
+/*!
+  This function creates a new solver object for the specified library.
+  When implementing new solvers, one has to add the newly created solvers to
+  this function. An error message is generated if the specific library is not supported
+  by the interface library.
+  @param mediumName Medium name
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+BaseSolver *SolverMap::createSolver(const string &mediumName, const string &libraryName, const string &substanceName){
 	// Test solver for compiler setup debugging
 	if (libraryName.compare("TestMedium") == 0)
-	  _solvers[solverKeyString] = new TestSolver(mediumName, libraryName, substanceName);
-	
+	  return new TestSolver(mediumName, libraryName, substanceName);
+
 #if (FLUIDPROP == 1)
 	// FluidProp solver
-	else if (libraryName.find("FluidProp") == 0)
-	  _solvers[solverKeyString] = new FluidPropSolver(mediumName, libraryName, substanceName);
+	if (libraryName.find("FluidProp") == 0)
+	  return new FluidPropSolver(mediumName, libraryName, substanceName);
 #endif // FLUIDPROP == 1
 
 #if (COOLPROP == 1)
 	// CoolProp solver
-	else if (libraryName.find("CoolProp") == 0)
-	  _solvers[solverKeyString] = new CoolPropSolver(mediumName, libraryName, substanceName);
+	if (libraryName.find("CoolProp") == 0)
+	  return new CoolPropSolver(mediumName, libraryName, substanceName);
 #endif // COOLPROP == 1
 
-	else {
-	  // Generate error message
-	  char error[100];
-	  sprintf(error, "Error: libraryName = %s is not supported by any external solver\n", libraryName.c_str());
-	  errorMessage(error);
-	}
-	// Return pointer to solver
-	return _solvers[solverKeyString];
-};
+	// Generate error message
+	char error[100];
+	sprintf(error, "Error: libraryName = %s is not supported by any external solver\n", libraryName.c_str());
+	errorMessage(error);
+	return NULL;
+}
+
+//! Check the names of a solver without creating it
+/*!
+  Returns an empty string if createSolver supports the library and the
+  substance name is valid for it, otherwise the error message. Substance
+  names of libraries without a check are assumed valid.
+  @param libraryName Library name
+  @param substanceName Substance name
+*/
+string SolverMap::checkSolver(const string &libraryName, const string &substanceName){
+	if (libraryName.compare("TestMedium") == 0)
+	  return "";
+
+#if (FLUIDPROP == 1)
+	if (libraryName.find("FluidProp") == 0)
+	  return "";
+#endif // FLUIDPROP == 1
+
+#if (COOLPROP == 1)
+	if (libraryName.find("CoolProp") == 0)
+	  return CoolPropSolver::checkSubstanceName(substanceName);
+#endif // COOLPROP == 1
+
+	return "libraryName = " + libraryName + " is not supported by any external solver";
+}
 
 //! Generate a unique solver key
 /*!
@@ -65,4 +349,4 @@ string SolverMap::solverKey(const string &libraryName, const string &substanceNa
 	return libraryName + "." + substanceName;
 }
 
-map<string, BaseSolver*> SolverMap::_solvers;
+THREAD_LOCAL SolverMap *SolverMap::_boundContext = NULL;
@@ -2,8 +2,10 @@
 #define SOLVERMAP_H_
 
 #include "include.h"
+#include "threading.h"
 
 class BaseSolver;
+struct SolverStatistics;
 
 //! Solver map
 /*!
@@ -11,18 +13,57 @@ class BaseSolver;
   from BaseSolver and that interfaces the external fluid property computation
   code. Only one instance is created for each external library.
 
+  A solver map is also the context of a simulation: it owns its solvers,
+  together with their caches and statistics, and deletes them when it is
+  destroyed. The static functions use the context bound to the calling
+  thread with bind(), or a process-wide default context if none is bound,
+  so that several simulations in the same process (e.g. FMU instances in
+  a co-simulation) can use separate contexts without sharing any state.
+
   Francesco Casella, Christoph Richter, Roberto Bonifetto
   2006-2012
   Copyright Politecnico di Milano, TU Braunschweig, Politecnico di Torino
 */
 class SolverMap{
 public:
+	SolverMap();
+	~SolverMap();
+
 	static BaseSolver *getSolver(const string &mediumName, const string &libraryName, const string &substanceName);
+	static BaseSolver *getWorkerSolver(int worker, const string &mediumName, const string &libraryName, const string &substanceName);
 	static string solverKey(const string &libraryName, const string &substanceName);
+	static string checkSolver(const string &libraryName, const string &substanceName);
+
+	static SolverMap *current();
+	static SolverMap *bind(SolverMap *context);
+
+	int acquire(const string &mediumName, const string &libraryName, const string &substanceName);
+	int release(const string &libraryName, const string &substanceName);
+	void releaseAll();
+	size_t memoryUsage(const string &libraryName, const string &substanceName);
+	string memoryReport();
+	SolverStatistics statistics(const string &libraryName, const string &substanceName);
 
 protected:
+	BaseSolver *solver(const string &solverKeyString, const string &mediumName, const string &libraryName, const string &substanceName);
+	static BaseSolver *createSolver(const string &mediumName, const string &libraryName, const string &substanceName);
+
+	void deleteSolvers(const string &solverKeyString);
+
 	//! Map for all solver instances identified by the SolverKey
-	static map<string, BaseSolver*> _solvers;
+	map<string, BaseSolver*> _solvers;
+	//! Number of references acquired for each solver key
+	map<string, int> _references;
+	//! Protects the maps of solvers and references
+	Mutex _solversMutex;
+
+	//! Context bound to the calling thread, NULL for the default context
+	static THREAD_LOCAL SolverMap *_boundContext;
+
+private:
+	// Contexts cannot be copied
+	SolverMap(const SolverMap &);
+	SolverMap &operator=(const SolverMap &);
 };
 
 #endif // SOLVERMAP_H_
@@ -3,7 +3,6 @@
 
 TestSolver::TestSolver(const string &mediumName, const string &libraryName, const string &substanceName)
 	: BaseSolver(mediumName, libraryName, substanceName){
-  setFluidConstants();
 }
 
 TestSolver::~TestSolver(){
@@ -16,6 +15,10 @@ void TestSolver::setFluidConstants(){
   _fluidConstants.dc = 322;
 }
 
+bool TestSolver::isReentrant(){
+	return true;
+}
+
 void TestSolver::setSat_p(double &p, ExternalSaturationProperties *const properties){
 	properties->Tsat = 372.0 + (393.0-373.0)*(p - 1.0e5)/1.0e5;
     properties->dTp = (393.0-373.0)/1.0e5;
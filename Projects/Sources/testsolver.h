@@ -37,6 +37,7 @@ public:
 	TestSolver(const string &mediumName, const string &libraryName, const string &substanceName);
 	~TestSolver();
 	virtual void setFluidConstants();
+	virtual bool isReentrant();
 
 	virtual void setSat_p(double &p, ExternalSaturationProperties *const properties);
 	virtual void setSat_T(double &T, ExternalSaturationProperties *const properties);
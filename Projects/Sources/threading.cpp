@@ -0,0 +1,190 @@
+/* *****************************************************************
+ * Implementation of the portable threading primitives
+ *
+ * Win32 critical sections and condition variables are used on
+ * Windows (Vista or later), POSIX threads everywhere else.
+ ********************************************************************/
+
+#include "threading.h"
+
+#if defined(__ISWINDOWS__)
+#include <windows.h>
+
+Mutex::Mutex(){
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection(cs);
+	_handle = cs;
+}
+
+Mutex::~Mutex(){
+	CRITICAL_SECTION *cs = (CRITICAL_SECTION*)_handle;
+	DeleteCriticalSection(cs);
+	delete cs;
+}
+
+void Mutex::lock(){
+	EnterCriticalSection((CRITICAL_SECTION*)_handle);
+}
+
+void Mutex::unlock(){
+	LeaveCriticalSection((CRITICAL_SECTION*)_handle);
+}
+
+ConditionVariable::ConditionVariable(){
+	CONDITION_VARIABLE *cv = new CONDITION_VARIABLE;
+	InitializeConditionVariable(cv);
+	_handle = cv;
+}
+
+ConditionVariable::~ConditionVariable(){
+	delete (CONDITION_VARIABLE*)_handle;
+}
+
+void ConditionVariable::wait(Mutex &mutex){
+	SleepConditionVariableCS((CONDITION_VARIABLE*)_handle, (CRITICAL_SECTION*)mutex._handle, INFINITE);
+}
+
+void ConditionVariable::notifyAll(){
+	WakeAllConditionVariable((CONDITION_VARIABLE*)_handle);
+}
+
+unsigned long currentThreadId(){
+	return (unsigned long)GetCurrentThreadId();
+}
+
+unsigned long currentProcessId(){
+	return (unsigned long)GetCurrentProcessId();
+}
+
+//! Arguments of a thread started by startThread
+struct ThreadStart{
+	void (*function)(void *);
+	void *argument;
+};
+
+static DWORD WINAPI threadMain(LPVOID parameter){
+	ThreadStart *start = (ThreadStart*)parameter;
+	start->function(start->argument);
+	delete start;
+	return 0;
+}
+
+bool startThread(void (*function)(void *), void *argument){
+	ThreadStart *start = new ThreadStart;
+	start->function = function;
+	start->argument = argument;
+	HANDLE thread = CreateThread(NULL, 0, threadMain, start, 0, NULL);
+	if (thread == NULL){
+		delete start;
+		return false;
+	}
+	CloseHandle(thread);
+	return true;
+}
+
+int processorCount(){
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
+
+void memoryBarrier(){
+	MemoryBarrier();
+}
+
+long atomicIncrement(volatile long *value){
+	return InterlockedIncrement(value);
+}
+
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+Mutex::Mutex(){
+	pthread_mutex_t *mutex = new pthread_mutex_t;
+	pthread_mutex_init(mutex, NULL);
+	_handle = mutex;
+}
+
+Mutex::~Mutex(){
+	pthread_mutex_t *mutex = (pthread_mutex_t*)_handle;
+	pthread_mutex_destroy(mutex);
+	delete mutex;
+}
+
+void Mutex::lock(){
+	pthread_mutex_lock((pthread_mutex_t*)_handle);
+}
+
+void Mutex::unlock(){
+	pthread_mutex_unlock((pthread_mutex_t*)_handle);
+}
+
+ConditionVariable::ConditionVariable(){
+	pthread_cond_t *cond = new pthread_cond_t;
+	pthread_cond_init(cond, NULL);
+	_handle = cond;
+}
+
+ConditionVariable::~ConditionVariable(){
+	pthread_cond_t *cond = (pthread_cond_t*)_handle;
+	pthread_cond_destroy(cond);
+	delete cond;
+}
+
+void ConditionVariable::wait(Mutex &mutex){
+	pthread_cond_wait((pthread_cond_t*)_handle, (pthread_mutex_t*)mutex._handle);
+}
+
+void ConditionVariable::notifyAll(){
+	pthread_cond_broadcast((pthread_cond_t*)_handle);
+}
+
+unsigned long currentThreadId(){
+	return (unsigned long)pthread_self();
+}
+
+unsigned long currentProcessId(){
+	return (unsigned long)getpid();
+}
+
+//! Arguments of a thread started by startThread
+struct ThreadStart{
+	void (*function)(void *);
+	void *argument;
+};
+
+static void *threadMain(void *parameter){
+	ThreadStart *start = (ThreadStart*)parameter;
+	start->function(start->argument);
+	delete start;
+	return NULL;
+}
+
+bool startThread(void (*function)(void *), void *argument){
+	ThreadStart *start = new ThreadStart;
+	start->function = function;
+	start->argument = argument;
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, threadMain, start) != 0){
+		delete start;
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+int processorCount(){
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+void memoryBarrier(){
+	__sync_synchronize();
+}
+
+long atomicIncrement(volatile long *value){
+	return __sync_add_and_fetch(value, 1);
+}
+
+#endif
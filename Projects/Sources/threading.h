@@ -0,0 +1,121 @@
+/*!
+  \file threading.h
+  \brief Portable threading primitives
+
+  Minimal wrappers around the native threading API (Win32 or POSIX
+  threads), so that the solvers can protect shared data without
+  depending on a specific compiler or C++ standard library version.
+*/
+
+#ifndef THREADING_H_
+#define THREADING_H_
+
+#include "include.h"
+
+// Storage class of variables with one instance per thread
+#if defined(_MSC_VER)
+#  define THREAD_LOCAL __declspec(thread)
+#else
+#  define THREAD_LOCAL __thread
+#endif
+
+//! Mutual exclusion lock
+/*!
+  Non-recursive mutex. The native handle is kept opaque to avoid
+  pulling the platform headers into every translation unit.
+*/
+class Mutex{
+public:
+	Mutex();
+	~Mutex();
+	void lock();
+	void unlock();
+
+private:
+	friend class ConditionVariable;
+	void *_handle;
+	// Mutexes cannot be copied
+	Mutex(const Mutex &);
+	Mutex &operator=(const Mutex &);
+};
+
+//! Condition variable
+/*!
+  Used together with a Mutex to let threads wait for a condition
+  signalled by another thread.
+*/
+class ConditionVariable{
+public:
+	ConditionVariable();
+	~ConditionVariable();
+	void wait(Mutex &mutex);
+	void notifyAll();
+
+private:
+	void *_handle;
+	ConditionVariable(const ConditionVariable &);
+	ConditionVariable &operator=(const ConditionVariable &);
+};
+
+//! Scoped lock
+/*!
+  Locks the mutex for the lifetime of the object.
+*/
+class ScopedLock{
+public:
+	ScopedLock(Mutex &mutex) : _mutex(mutex){ _mutex.lock(); }
+	~ScopedLock(){ _mutex.unlock(); }
+
+private:
+	Mutex &_mutex;
+	ScopedLock(const ScopedLock &);
+	ScopedLock &operator=(const ScopedLock &);
+};
+
+//! Return an identifier of the calling thread
+unsigned long currentThreadId();
+
+//! Return an identifier of the calling process
+unsigned long currentProcessId();
+
+//! Start a detached thread running function(argument)
+bool startThread(void (*function)(void *), void *argument);
+
+//! Return the number of processors available to the process
+int processorCount();
+
+//! Full memory barrier
+void memoryBarrier();
+
+//! Increment a counter shared by several threads and return the new value
+long atomicIncrement(volatile long *value);
+
+//! Flag of a value that is computed on first need
+/*!
+  The value is computed by the thread that needs it without holding a
+  lock, since the error function of the Modelica tool may not return and
+  would leave the lock held. The flag therefore does not guarantee a
+  single computation: threads racing on the first use of the same object
+  all compute the value, which must give the same result and must not
+  acquire resources that the object releases only once. setDone()
+  publishes the value to the threads that see done() return true.
+*/
+class OnceFlag{
+public:
+	OnceFlag() : _done(false){}
+	bool done() const{
+		if (!_done)
+			return false;
+		memoryBarrier();
+		return true;
+	}
+	void setDone(){
+		memoryBarrier();
+		_done = true;
+	}
+
+private:
+	volatile bool _done;
+};
+
+#endif // THREADING_H_
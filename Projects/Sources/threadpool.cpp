@@ -0,0 +1,325 @@
+/* *****************************************************************
+ * Implementation of the worker pool for batched property calls
+ ********************************************************************/
+
+#include "threadpool.h"
+#include <stdlib.h>
+#include <string.h>
+
+//! Arguments of a worker thread
+struct WorkerStart{
+	ThreadPool *pool;
+	int index;
+	unsigned long generation;
+};
+
+//! Report a warning collected during a job on the calling thread
+static void reportWarning(const string &message){
+	// Leave room for the line feed appended by some implementations
+	std::vector<char> buffer(message.begin(), message.end());
+	buffer.resize(message.size() + 2, '\0');
+	warningMessage(&buffer[0]);
+}
+
+ThreadPool::ThreadPool()
+	: _chunk(1), _started(0), _busy(false), _generation(0), _task(NULL), _active(0), _pending(0), _hasError(false){
+	const char *threads = getenv("EXTERNALMEDIA_THREADS");
+	const char *minChunk = getenv("EXTERNALMEDIA_MIN_CHUNK");
+	_threads = (threads && atoi(threads) > 0) ? atoi(threads) : processorCount();
+	_minChunk = (minChunk && atoi(minChunk) > 0) ? atoi(minChunk) : 16;
+}
+
+//! Return the thread pool
+/*!
+  The pool is created on first use; the worker threads are started
+  by the first job that needs them.
+*/
+ThreadPool &ThreadPool::instance(){
+	static ThreadPool *pool = new ThreadPool();
+	return *pool;
+}
+
+//! Set the number of threads and the minimum chunk size
+/*!
+  @param threads Number of threads including the calling thread, ignored if not positive
+  @param minChunk Minimum number of elements processed at once, ignored if not positive
+*/
+void ThreadPool::configure(int threads, int minChunk){
+	ScopedLock lock(_configMutex);
+	if (threads > 0)
+		_threads = threads;
+	if (minChunk > 0)
+		_minChunk = minChunk;
+}
+
+//! Number of threads, including the calling thread
+int ThreadPool::threads(){
+	ScopedLock lock(_configMutex);
+	return _threads;
+}
+
+//! Minimum number of elements processed at once
+int ThreadPool::minChunk(){
+	ScopedLock lock(_configMutex);
+	return _minChunk;
+}
+
+//! Number of threads used for a batch of n elements
+/*!
+  Each thread gets at least minChunk elements.
+  @param n Number of elements
+  @param minChunk Minimum number of elements per thread, 0 for the configured one
+*/
+int ThreadPool::workers(int n, int minChunk){
+	ScopedLock lock(_configMutex);
+	int workers = n/(minChunk > 0 ? minChunk : _minChunk);
+	if (workers > _threads)
+		workers = _threads;
+	return workers > 1 ? workers : 1;
+}
+
+//! Process n elements with the task
+/*!
+  Batches too small to be shared, and batches started while the workers
+  are busy with another job, are processed on the calling thread only.
+  Otherwise the elements are split evenly among the workers, which then
+  balance the load by stealing work from each other.
+  @param n Number of elements
+  @param maxWorkers Maximum number of workers the task supports
+  @param task Task processing the elements
+  @param minChunk Minimum number of elements processed at once, 0 for the
+  configured one; expensive elements, e.g. whole solvers, use 1
+*/
+void ThreadPool::run(int n, int maxWorkers, ThreadPoolTask &task, int minChunk){
+	int active = workers(n, minChunk);
+	if (active > maxWorkers)
+		active = maxWorkers;
+	if (active <= 1 || !startJob()){
+		task.execute(0, 0, n);
+		return;
+	}
+
+	// The error is reported from a plain buffer, since the Modelica error
+	// function does not return and would skip the destructors
+	char error[1000];
+	if (runJob(n, active, minChunk > 0 ? minChunk : this->minChunk(), task, error, sizeof(error)))
+		errorMessage(error);
+}
+
+//! Reserve the worker threads for a job
+/*!
+  Returns false if another job is using them. The reservation is released
+  by runJob.
+*/
+bool ThreadPool::startJob(){
+	ScopedLock lock(_mutex);
+	if (_busy)
+		return false;
+	_busy = true;
+	return true;
+}
+
+//! Run a job on the worker threads reserved by startJob
+/*!
+  Reports the collected warnings and returns true if an error was raised,
+  which is then copied to the error buffer.
+*/
+bool ThreadPool::runJob(int n, int active, int chunk, ThreadPoolTask &task, char *error, int size){
+	bool hasError;
+	std::vector<string> warnings;
+	{
+		_chunk = chunk;
+
+		// Start the missing worker threads
+		while (_started < active - 1){
+			WorkerStart *start = new WorkerStart;
+			start->pool = this;
+			start->index = _started + 1;
+			{
+				ScopedLock lock(_mutex);
+				start->generation = _generation;
+			}
+			if (!startThread(workerMain, start)){
+				delete start;
+				break;
+			}
+			_started++;
+		}
+		if (active > _started + 1)
+			active = _started + 1;
+
+		// Split the elements evenly among the workers
+		while ((int)_ranges.size() < active)
+			_ranges.push_back(new Range);
+		for (int i = 0; i < active; i++){
+			_ranges[i]->begin = (int)((double)n*i/active);
+			_ranges[i]->end = (int)((double)n*(i + 1)/active);
+		}
+
+		{
+			ScopedLock lock(_messagesMutex);
+			_deferringThreads.insert(currentThreadId());
+			_hasError = false;
+			_error.clear();
+			_warnings.clear();
+		}
+
+		{
+			ScopedLock lock(_mutex);
+			_task = &task;
+			_active = active;
+			_pending = active - 1;
+			_generation++;
+			_jobStarted.notifyAll();
+		}
+
+		work(0, &task);
+
+		{
+			ScopedLock lock(_mutex);
+			while (_pending > 0)
+				_jobDone.wait(_mutex);
+			_task = NULL;
+		}
+
+		{
+			ScopedLock lock(_messagesMutex);
+			_deferringThreads.erase(currentThreadId());
+			hasError = _hasError;
+			strncpy(error, _error.c_str(), size - 2);
+			error[size - 2] = '\0';
+			warnings.swap(_warnings);
+		}
+
+		ScopedLock lock(_mutex);
+		_busy = false;
+	}
+
+	// Report the warnings once the pool is ready for the next job
+	for (unsigned int i = 0; i < warnings.size(); i++)
+		reportWarning(warnings[i]);
+	return hasError;
+}
+
+//! Main loop of the worker threads
+void ThreadPool::workerMain(void *argument){
+	WorkerStart *start = (WorkerStart*)argument;
+	ThreadPool *pool = start->pool;
+	int index = start->index;
+	unsigned long seen = start->generation;
+	delete start;
+
+	{
+		ScopedLock lock(pool->_messagesMutex);
+		pool->_deferringThreads.insert(currentThreadId());
+	}
+
+	for (;;){
+		ThreadPoolTask *task = NULL;
+		{
+			ScopedLock lock(pool->_mutex);
+			while (pool->_generation == seen)
+				pool->_jobStarted.wait(pool->_mutex);
+			seen = pool->_generation;
+			if (index < pool->_active)
+				task = pool->_task;
+		}
+		if (task == NULL)
+			continue;
+		pool->work(index, task);
+		{
+			ScopedLock lock(pool->_mutex);
+			if (--pool->_pending == 0)
+				pool->_jobDone.notifyAll();
+		}
+	}
+}
+
+//! Process chunks until no work is left
+void ThreadPool::work(int worker, ThreadPoolTask *task){
+	int begin, end;
+	for (;;){
+		if (nextChunk(worker, begin, end))
+			task->execute(worker, begin, end);
+		else if (!steal(worker))
+			break;
+	}
+}
+
+//! Take the next chunk from the front of the range of the worker
+bool ThreadPool::nextChunk(int worker, int &begin, int &end){
+	Range *range = _ranges[worker];
+	ScopedLock lock(range->mutex);
+	if (range->begin >= range->end)
+		return false;
+	begin = range->begin;
+	end = range->end - range->begin > _chunk ? range->begin + _chunk : range->end;
+	range->begin = end;
+	return true;
+}
+
+//! Move the back half of the largest remaining range to the worker
+/*!
+  Returns false if no work is left in any range.
+*/
+bool ThreadPool::steal(int worker){
+	for (;;){
+		int victim = -1;
+		int largest = 0;
+		for (int i = 0; i < _active; i++){
+			if (i == worker)
+				continue;
+			ScopedLock lock(_ranges[i]->mutex);
+			if (_ranges[i]->end - _ranges[i]->begin > largest){
+				largest = _ranges[i]->end - _ranges[i]->begin;
+				victim = i;
+			}
+		}
+		if (victim < 0)
+			return false;
+
+		int begin, end;
+		{
+			Range *range = _ranges[victim];
+			ScopedLock lock(range->mutex);
+			int remaining = range->end - range->begin;
+			if (remaining <= 0)
+				continue; // taken meanwhile, look again
+			end = range->end;
+			begin = remaining > _chunk ? end - (remaining + 1)/2 : range->begin;
+			range->end = begin;
+		}
+		{
+			Range *range = _ranges[worker];
+			ScopedLock lock(range->mutex);
+			range->begin = begin;
+			range->end = end;
+		}
+		return true;
+	}
+}
+
+//! Collect a message if the calling thread takes part in a job
+/*!
+  Called by errorMessage() and warningMessage(). Returns true if the
+  message has been collected, to be reported at the end of the job;
+  only the first error is kept.
+  @param error True for errors, false for warnings
+  @param message Message text
+*/
+bool ThreadPool::deferMessage(bool error, const char *message){
+	return instance().deferMessageFromThread(error, message);
+}
+
+bool ThreadPool::deferMessageFromThread(bool error, const char *message){
+	ScopedLock lock(_messagesMutex);
+	if (_deferringThreads.find(currentThreadId()) == _deferringThreads.end())
+		return false;
+	if (!error)
+		_warnings.push_back(message);
+	else if (!_hasError){
+		_hasError = true;
+		_error = message;
+	}
+	return true;
+}
@@ -0,0 +1,110 @@
+/*!
+  \file threadpool.h
+  \brief Persistent worker pool for batched property calls
+
+  Large batches of property calls are split among a fixed set of worker
+  threads, which are started on first use and then wait for new jobs.
+  The calling thread takes part in each job as worker 0.
+
+  Each worker owns a contiguous range of the batch and processes it in
+  chunks from the front; a worker that runs out of elements steals the
+  back half of the largest remaining range of another worker, so that
+  expensive points (two-phase, near-critical) do not leave the other
+  threads idle.
+
+  The number of threads and the minimum chunk size are read from the
+  environment variables EXTERNALMEDIA_THREADS (default: number of
+  processors) and EXTERNALMEDIA_MIN_CHUNK (default: 16), and can be
+  changed at run time with configure().
+*/
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include "include.h"
+#include "threading.h"
+#include <set>
+#include <vector>
+
+//! Work item of a thread pool job
+class ThreadPoolTask{
+public:
+	virtual ~ThreadPoolTask(){}
+	//! Process the elements [begin, end) on the given worker (0 = calling thread)
+	virtual void execute(int worker, int begin, int end) = 0;
+};
+
+//! Thread pool
+/*!
+  Jobs are run one at a time; run() returns when all the elements have
+  been processed. A job started while another one is running, by another
+  thread or by a task of the running job, is processed by its calling
+  thread alone instead of waiting, so that no lock is held while the
+  tasks run. Errors and warnings raised by errorMessage() and
+  warningMessage() during a job are collected and reported on the calling
+  thread after the job is complete, since the Modelica error functions
+  must not be called from other threads.
+*/
+class ThreadPool{
+public:
+	static ThreadPool &instance();
+
+	void configure(int threads, int minChunk);
+	int threads();
+	int minChunk();
+	int workers(int n, int minChunk = 0);
+	void run(int n, int maxWorkers, ThreadPoolTask &task, int minChunk = 0);
+
+	static bool deferMessage(bool error, const char *message);
+
+private:
+	ThreadPool();
+
+	//! Range of elements still to be processed by a worker
+	struct Range{
+		Mutex mutex;
+		int begin;
+		int end;
+	};
+
+	static void workerMain(void *argument);
+	bool startJob();
+	bool runJob(int n, int active, int chunk, ThreadPoolTask &task, char *error, int size);
+	void work(int worker, ThreadPoolTask *task);
+	bool nextChunk(int worker, int &begin, int &end);
+	bool steal(int worker);
+	bool deferMessageFromThread(bool error, const char *message);
+
+	//! Configured number of threads, including the calling thread
+	int _threads;
+	//! Minimum number of elements processed at once
+	int _minChunk;
+	//! Minimum number of elements processed at once in the current job
+	int _chunk;
+	//! Element ranges of the workers of the current job
+	std::vector<Range*> _ranges;
+	//! Number of worker threads started so far
+	int _started;
+
+	//! Protects the configuration
+	Mutex _configMutex;
+	//! Protects the job state below
+	Mutex _mutex;
+	//! Set while a job uses the worker threads
+	bool _busy;
+	ConditionVariable _jobStarted;
+	ConditionVariable _jobDone;
+	unsigned long _generation;
+	ThreadPoolTask *_task;
+	int _active;
+	int _pending;
+
+	//! Messages raised by the threads of the current job
+	Mutex _messagesMutex;
+	std::set<unsigned long> _deferringThreads;
+	bool _hasError;
+	string _error;
+	std::vector<string> _warnings;
+};
+
+#endif // THREADPOOL_H_
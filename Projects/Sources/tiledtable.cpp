@@ -0,0 +1,308 @@
+/* *****************************************************************
+ * Implementation of the property table filled on first access
+ ********************************************************************/
+
+#include "tiledtable.h"
+#include <stdio.h>
+#include <math.h>
+
+//! Interpolated fields of the state record; p and h are the inputs
+static double ExternalThermodynamicState::*const interpolatedFields[] = {
+	&ExternalThermodynamicState::T, &ExternalThermodynamicState::a,
+	&ExternalThermodynamicState::beta, &ExternalThermodynamicState::cp,
+	&ExternalThermodynamicState::cv, &ExternalThermodynamicState::d,
+	&ExternalThermodynamicState::ddhp, &ExternalThermodynamicState::ddph,
+	&ExternalThermodynamicState::eta, &ExternalThermodynamicState::kappa,
+	&ExternalThermodynamicState::lambda, &ExternalThermodynamicState::s
+};
+static const int interpolatedFieldCount = sizeof(interpolatedFields)/sizeof(interpolatedFields[0]);
+
+//! Return true if the interpolated state is within the tolerance of the exact one
+/*!
+  All the interpolated properties are checked, relative to their value;
+  the entropy may be close to zero, hence an absolute scale of 1 J/(kg.K)
+  for it. Properties not computed by the source (NaN) are not checked.
+*/
+static bool withinTolerance(const ExternalThermodynamicState &interpolated, const ExternalThermodynamicState &exact, double tolerance){
+	for (int k = 0; k < interpolatedFieldCount; k++){
+		double ExternalThermodynamicState::*field = interpolatedFields[k];
+		if (exact.*field != exact.*field)
+			continue;
+		double scale = fabs(exact.*field) + (field == &ExternalThermodynamicState::s ? 1.0 : 0.0);
+		if (!(fabs(interpolated.*field - exact.*field) <= tolerance*scale))
+			return false;
+	}
+	return true;
+}
+
+//! Largest cell index, beyond which queries are not tabulated
+static const double maxCellIndex = 1e9;
+
+static Mutex sharedTablesMutex;
+static map<string, TiledTable*> sharedTables;
+
+//! Integer division rounding towards minus infinity
+static long floorDiv(long a, long b){
+	return a >= 0 ? a/b : -((-a + b - 1)/b);
+}
+
+//! Constructor
+/*!
+  @param dlogp Cell size in natural logarithm of the pressure
+  @param dh Cell size in specific enthalpy
+  @param cells Number of cells per tile side
+  @param tolerance Relative tolerance of the check at the cell centres, 0 for no check
+*/
+TiledTable::TiledTable(double dlogp, double dh, int cells, double tolerance)
+	: _dlogp(dlogp), _dh(dh), _cells(cells), _tolerance(tolerance), _misses(0), _references(0){
+}
+
+//! Destructor
+TiledTable::~TiledTable(){
+	for (int k = 0; k < SHARD_COUNT; k++)
+		for (map<TileIndex, Tile*>::iterator it = _shards[k].tiles.begin(); it != _shards[k].tiles.end(); ++it)
+			delete it->second;
+}
+
+//! Interpolate the state at the given inputs
+/*!
+  Computes the tile of the query first if it has not been computed yet.
+  @param p Pressure
+  @param h Specific enthalpy
+  @param source Source of the node values
+  @param properties ExternalThermodynamicState property struct
+  @return True if the state was interpolated, false if it must be computed by the caller
+*/
+bool TiledTable::lookup(double p, double h, TiledTableSource &source, ExternalThermodynamicState *const properties){
+	if (!(p > 0))
+		return false;
+	double x = log(p)/_dlogp;
+	double y = h/_dh;
+	if (!(fabs(x) < maxCellIndex && fabs(y) < maxCellIndex))
+		return false;
+	double fx = floor(x);
+	double fy = floor(y);
+	long cx = (long)fx;
+	long cy = (long)fy;
+	TileIndex index(floorDiv(cx, _cells), floorDiv(cy, _cells));
+	int i = (int)(cx - index.first*_cells);
+	int j = (int)(cy - index.second*_cells);
+
+	Shard &shard = _shards[((unsigned long)index.first*31 + (unsigned long)index.second) % SHARD_COUNT];
+	Tile *tile;
+	bool compute = false;
+	{
+		ScopedLock lock(shard.mutex);
+		map<TileIndex, Tile*>::iterator it = shard.tiles.find(index);
+		if (it != shard.tiles.end())
+			tile = it->second;
+		else
+			tile = shard.tiles[index] = new Tile;
+		if (!tile->ready.done()){
+			if (tile->computing){
+				// Computed by another thread in the meantime
+				atomicIncrement(&_misses);
+				return false;
+			}
+			tile->computing = true;
+			compute = true;
+		}
+	}
+	if (compute)
+		computeTile(index, source, tile);
+
+	// The nodes of a computed tile are not changed any more
+	if (!tile->usable[i*_cells + j]){
+		atomicIncrement(&_misses);
+		return false;
+	}
+	atomicIncrement(&tile->hits);
+	interpolate(tile, i, j, x - fx, y - fy, properties);
+	properties->p = p;
+	properties->h = h;
+	return true;
+}
+
+//! Interpolate the state in a cell of a computed tile
+/*!
+  @param tile Computed tile
+  @param i Cell index in pressure within the tile
+  @param j Cell index in enthalpy within the tile
+  @param wx Relative position in the cell in log(p)
+  @param wy Relative position in the cell in h
+  @param properties ExternalThermodynamicState property struct, p and h are not set
+*/
+void TiledTable::interpolate(const Tile *tile, int i, int j, double wx, double wy, ExternalThermodynamicState *const properties) const{
+	int n = _cells + 1;
+	const ExternalThermodynamicState *node00 = &tile->nodes[i*n + j];
+	const ExternalThermodynamicState *node01 = node00 + 1;
+	const ExternalThermodynamicState *node10 = node00 + n;
+	const ExternalThermodynamicState *node11 = node10 + 1;
+	double w00 = (1 - wx)*(1 - wy), w01 = (1 - wx)*wy, w10 = wx*(1 - wy), w11 = wx*wy;
+	for (int k = 0; k < interpolatedFieldCount; k++){
+		double ExternalThermodynamicState::*field = interpolatedFields[k];
+		// Equal values are copied, so that values not computed (NAN) are kept exactly
+		if (node00->*field == node01->*field && node00->*field == node10->*field && node00->*field == node11->*field)
+			properties->*field = node00->*field;
+		else
+			properties->*field = w00*(node00->*field) + w01*(node01->*field) + w10*(node10->*field) + w11*(node11->*field);
+	}
+	properties->phase = node00->phase;
+}
+
+//! Compute the nodes of a tile
+/*!
+  Called without the table locked, by the only thread that set the
+  computing flag of the tile.
+  @param index Tile index
+  @param source Source of the node values
+  @param tile Tile
+*/
+void TiledTable::computeTile(const TileIndex &index, TiledTableSource &source, Tile *tile){
+	int n = _cells + 1;
+	std::vector<ExternalThermodynamicState> nodes(n*n);
+	std::vector<int> regions(n*n);
+	for (int i = 0; i < n; i++){
+		double p = exp((index.first*_cells + i)*_dlogp);
+		for (int j = 0; j < n; j++){
+			double h = (index.second*_cells + j)*_dh;
+			regions[i*n + j] = source.tableNode(p, h, &nodes[i*n + j]);
+		}
+	}
+	tile->nodes.swap(nodes);
+
+	// A cell is interpolated if its four nodes belong to the same valid region
+	// and, with a tolerance, if it matches the source at its centre
+	std::vector<char> usable(_cells*_cells);
+	for (int i = 0; i < _cells; i++){
+		for (int j = 0; j < _cells; j++){
+			int region = regions[i*n + j];
+			bool ok = region != 0 && regions[i*n + j + 1] == region &&
+				regions[(i + 1)*n + j] == region && regions[(i + 1)*n + j + 1] == region;
+			if (ok && _tolerance > 0){
+				ExternalThermodynamicState exact, interpolated;
+				double p = exp((index.first*_cells + i + 0.5)*_dlogp);
+				double h = (index.second*_cells + j + 0.5)*_dh;
+				ok = source.tableNode(p, h, &exact) == region;
+				if (ok){
+					interpolate(tile, i, j, 0.5, 0.5, &interpolated);
+					ok = withinTolerance(interpolated, exact, _tolerance);
+				}
+			}
+			usable[i*_cells + j] = ok;
+		}
+	}
+	tile->usable.swap(usable);
+	tile->ready.setDone();
+}
+
+//! Return the tile occupancy statistics
+TiledTableStatistics TiledTable::statistics(){
+	TiledTableStatistics statistics;
+	statistics.tiles = 0;
+	statistics.hits = 0;
+	statistics.misses = _misses;
+	for (int k = 0; k < SHARD_COUNT; k++){
+		ScopedLock lock(_shards[k].mutex);
+		for (map<TileIndex, Tile*>::iterator it = _shards[k].tiles.begin(); it != _shards[k].tiles.end(); ++it){
+			if (it->second->ready.done()){
+				statistics.tiles++;
+				statistics.hits += it->second->hits;
+			}
+		}
+	}
+	return statistics;
+}
+
+//! Return a report of the computed tiles
+/*!
+  One line per tile with its pressure and enthalpy ranges and the number
+  of queries interpolated in it, followed by the totals and the estimated
+  memory used by the table.
+*/
+string TiledTable::report(){
+	string report;
+	char line[200];
+	long tiles = 0, hits = 0;
+	for (int k = 0; k < SHARD_COUNT; k++){
+		ScopedLock lock(_shards[k].mutex);
+		for (map<TileIndex, Tile*>::iterator it = _shards[k].tiles.begin(); it != _shards[k].tiles.end(); ++it){
+			if (!it->second->ready.done())
+				continue;
+			const TileIndex &index = it->first;
+			snprintf(line, sizeof(line), "p = %g..%g Pa, h = %g..%g J/kg: %ld hits\n",
+				exp(index.first*_cells*_dlogp), exp((index.first + 1)*_cells*_dlogp),
+				index.second*_cells*_dh, (index.second + 1)*_cells*_dh, it->second->hits);
+			report += line;
+			tiles++;
+			hits += it->second->hits;
+		}
+	}
+	snprintf(line, sizeof(line), "Total: %ld tiles, %ld hits, %ld misses, %lu bytes\n", tiles, hits, _misses, (unsigned long)memoryUsage());
+	return report + line;
+}
+
+//! Estimate the memory used by the table in bytes
+size_t TiledTable::memoryUsage(){
+	size_t bytes = sizeof(*this);
+	for (int k = 0; k < SHARD_COUNT; k++){
+		ScopedLock lock(_shards[k].mutex);
+		for (map<TileIndex, Tile*>::iterator it = _shards[k].tiles.begin(); it != _shards[k].tiles.end(); ++it){
+			bytes += sizeof(Tile) + 4*sizeof(void *);
+			if (it->second->ready.done())
+				bytes += it->second->nodes.capacity()*sizeof(ExternalThermodynamicState) + it->second->usable.capacity();
+		}
+	}
+	return bytes;
+}
+
+//! Estimate the share of the memory of a shared table used by one of its users
+/*!
+  The memory of the table divided by its number of users, so that the
+  shares of all the solvers using the table add up to its memory.
+*/
+size_t TiledTable::memoryShare(){
+	size_t bytes = memoryUsage();
+	ScopedLock lock(sharedTablesMutex);
+	return bytes/(_references > 0 ? _references : 1);
+}
+
+//! Return the table shared by the solvers of a fluid, created on first use
+/*!
+  Each call takes a reference to the table, which must be given back with
+  release() when the caller is deleted.
+  @param key Key of the fluid, holding the library and the substance name with its options
+  @param dlogp Cell size in natural logarithm of the pressure
+  @param dh Cell size in specific enthalpy
+  @param tolerance Relative tolerance of the check at the cell centres
+*/
+TiledTable *TiledTable::shared(const string &key, double dlogp, double dh, double tolerance){
+	ScopedLock lock(sharedTablesMutex);
+	map<string, TiledTable*>::iterator it = sharedTables.find(key);
+	if (it != sharedTables.end()){
+		it->second->_references++;
+		return it->second;
+	}
+	TiledTable *table = new TiledTable(dlogp, dh, 8, tolerance);
+	table->_key = key;
+	table->_references = 1;
+	sharedTables[key] = table;
+	return table;
+}
+
+//! Give back a reference to a shared table
+/*!
+  The table is deleted when its last user releases it.
+  @param table Table returned by shared(), NULL is ignored
+*/
+void TiledTable::release(TiledTable *table){
+	if (table == NULL)
+		return;
+	{
+		ScopedLock lock(sharedTablesMutex);
+		if (--table->_references > 0)
+			return;
+		sharedTables.erase(table->_key);
+	}
+	delete table;
+}
@@ -0,0 +1,120 @@
+/*!
+  \file tiledtable.h
+  \brief Property table in (p,h) filled on first access
+
+  The (log p, h) plane is split into square tiles of cells, and the
+  nodes of a tile are computed by a TiledTableSource when a query first
+  lands in it. Most simulations only visit a small part of the state
+  space of a fluid, so the table gives interpolated look-ups after a
+  fraction of the construction time and memory of a full table.
+
+  Each node is tagged with a region by the source, e.g. liquid or vapour
+  side of the critical enthalpy. A query is interpolated bilinearly from
+  the four nodes of its cell if they belong to the same valid region;
+  otherwise, or while another thread is computing the tile, the caller
+  computes the state with the equation of state. If a tolerance is given,
+  each cell is also checked at its centre, where the error of bilinear
+  interpolation is largest for smooth properties, against the source, and
+  cells where any interpolated property deviates more than the tolerance
+  are left to the equation of state as well.
+
+  The tiles are computed without holding a lock, since the error
+  function of the Modelica tool may not return; a tile whose computation
+  did not complete is never used. The tiles are spread over several maps
+  with their own lock, held only to find a tile; computed tiles are never
+  changed again and are read without lock.
+*/
+
+#ifndef TILEDTABLE_H_
+#define TILEDTABLE_H_
+
+#include "include.h"
+#include "externalmedialib.h"
+#include "threading.h"
+#include <vector>
+
+//! Source of the node values of a TiledTable
+class TiledTableSource{
+public:
+	virtual ~TiledTableSource(){}
+	//! Compute the state at a node
+	/*!
+	  Must compute all the properties and must not report errors.
+	  @param p Pressure
+	  @param h Specific enthalpy
+	  @param properties ExternalThermodynamicState property struct
+	  @return Region of the state, 0 if it cannot be interpolated
+	*/
+	virtual int tableNode(double p, double h, ExternalThermodynamicState *const properties) = 0;
+};
+
+//! Tile occupancy statistics of a TiledTable
+struct TiledTableStatistics{
+	//! Number of computed tiles
+	long tiles;
+	//! Number of queries interpolated from the table
+	long hits;
+	//! Number of queries left to the equation of state
+	long misses;
+};
+
+//! Property table in (p,h) filled on first access
+class TiledTable{
+public:
+	TiledTable(double dlogp, double dh, int cells = 8, double tolerance = 0);
+	~TiledTable();
+
+	bool lookup(double p, double h, TiledTableSource &source, ExternalThermodynamicState *const properties);
+	TiledTableStatistics statistics();
+	string report();
+
+	size_t memoryUsage();
+	size_t memoryShare();
+
+	static TiledTable *shared(const string &key, double dlogp, double dh, double tolerance);
+	static void release(TiledTable *table);
+
+private:
+	//! Tile of cells x cells cells, with (cells + 1)^2 nodes
+	struct Tile{
+		Tile() : computing(false), hits(0){}
+		//! Set when the nodes have been computed; nodes and usable are read-only afterwards
+		OnceFlag ready;
+		//! Set while a thread is computing the nodes, protected by the lock of the shard
+		bool computing;
+		volatile long hits;
+		std::vector<ExternalThermodynamicState> nodes;
+		//! Flags of the cells that can be interpolated
+		std::vector<char> usable;
+	};
+	typedef std::pair<long, long> TileIndex;
+	//! Part of the tiles, with its own lock
+	struct Shard{
+		map<TileIndex, Tile*> tiles;
+		Mutex mutex;
+	};
+	enum { SHARD_COUNT = 16 };
+
+	void computeTile(const TileIndex &index, TiledTableSource &source, Tile *tile);
+	void interpolate(const Tile *tile, int i, int j, double wx, double wy, ExternalThermodynamicState *const properties) const;
+
+	//! Cell size in natural logarithm of the pressure
+	double _dlogp;
+	//! Cell size in specific enthalpy
+	double _dh;
+	//! Number of cells per tile side
+	int _cells;
+	//! Relative tolerance of the check at the cell centres, 0 if not checked
+	double _tolerance;
+	Shard _shards[SHARD_COUNT];
+	volatile long _misses;
+	//! Key and number of users of a shared table, protected by the lock of the shared tables
+	string _key;
+	int _references;
+
+	// Tables cannot be copied
+	TiledTable(const TiledTable &);
+	TiledTable &operator=(const TiledTable &);
+};
+
+#endif // TILEDTABLE_H_
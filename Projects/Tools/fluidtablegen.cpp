@@ -0,0 +1,70 @@
+/* *****************************************************************
+ * Generator of the built-in fluid table (see Sources/fluidtable.h)
+ *
+ * Computes the molar mass, the critical point and the near-critical
+ * saturation properties of the given CoolProp fluids with the library
+ * itself, and writes the table to the standard output in the format
+ * of Sources/fluidtable.inc. Usage:
+ *
+ *   fluidtablegen [substanceName ...]
+ *
+ * The default fluids are Water, CO2, R134a, R1234yf, Propane, Ammonia
+ * and Air. The Linux makefile runs the generator when building the
+ * library; its target "fluidtable" also replaces Sources/fluidtable.inc.
+ * The generator itself is linked with the placeholder table.
+ ********************************************************************/
+
+#include "externalmedialib.h"
+#include "coolpropsolver.h"
+#include "CoolProp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Relative margin of the near-critical saturation pressure, as in CoolPropSolver
+static const double p_eps = 1e-3;
+
+// The library reports errors through the Modelica utility functions
+extern "C" {
+void ModelicaError(const char *string){
+	fprintf(stderr, "Error: %s\n", string);
+	exit(1);
+}
+
+void ModelicaMessage(const char *string){
+	fprintf(stderr, "%s\n", string);
+}
+}
+
+int main(int argc, char *argv[]){
+	static const char *defaultFluids[] = {"Water", "CO2", "R134a", "R1234yf", "Propane", "Ammonia", "Air"};
+	const char **fluids = argc > 1 ? (const char **)argv + 1 : defaultFluids;
+	int n = argc > 1 ? argc - 1 : (int)(sizeof(defaultFluids)/sizeof(defaultFluids[0]));
+	const char *mediumName = "FluidTable";
+	const char *libraryName = "CoolProp";
+
+	// Compute everything from the backend, without the critical band
+	TwoPhaseMedium_setCacheDirectory_C_impl("");
+	TwoPhaseMedium_setCriticalBand_C_impl(0, 0);
+
+	printf("// Fluid table used by fluidtable.cpp, generated by Tools/fluidtablegen.\n");
+	printf("// Do not edit; run \"make -f makefile-linux fluidtable\" to regenerate.\n");
+	printf("static const char *const fluidTableVersion = \"%s\";\n", CoolPropSolver::backendVersion().c_str());
+	printf("static const FluidTableEntry fluidTable[] = {\n");
+	for (int i = 0; i < n; i++){
+		double MM = TwoPhaseMedium_getMolarMass_C_impl(mediumName, libraryName, fluids[i]);
+		double pc = TwoPhaseMedium_getCriticalPressure_C_impl(mediumName, libraryName, fluids[i]);
+		double Tc = TwoPhaseMedium_getCriticalTemperature_C_impl(mediumName, libraryName, fluids[i]);
+		// Same call as CoolPropSolver::setFluidConstants, there is no getter for the critical density
+		double dc = PropsSI((char *)"rhocrit", (char *)"T", 0, (char *)"P", 0, (char *)fluids[i]);
+		ExternalSaturationProperties sat;
+		TwoPhaseMedium_setSat_p_C_impl(pc*(1.0 - p_eps), &sat, mediumName, libraryName, fluids[i]);
+		printf("\t{\"%s\", %.17g, %.17g, %.17g, %.17g, %.17g,\n", fluids[i], MM, pc, Tc, dc, p_eps);
+		// Same order as the fields of ExternalSaturationProperties
+		printf("\t\t{%.17g, %.17g, %.17g, %.17g, %.17g, %.17g, %.17g,\n", sat.Tsat, sat.dTp, sat.ddldp, sat.ddvdp, sat.dhldp, sat.dhvdp, sat.dl);
+		printf("\t\t %.17g, %.17g, %.17g, %.17g, %.17g, %.17g, %.17g}},\n", sat.dv, sat.hl, sat.hv, sat.psat, sat.sigma, sat.sl, sat.sv);
+	}
+	printf("\t{NULL, 0, 0, 0, 0, 0,\n");
+	printf("\t\t{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}}\n");
+	printf("};\n");
+	return 0;
+}